@@ -0,0 +1,130 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include "bench.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef int (*benchFunc)(benchFile_s *);
+
+struct benchmark
+{
+    const char *name;
+    benchFunc func;
+};
+
+static struct benchmark benchmarks[] =
+{
+    { "frame", benchFrame },
+    { "keywords", benchKeywords },
+    { "regex", benchRegex },
+    { "render", benchRender },
+};
+
+
+/*
+ * Returns a monotonic time stamp in seconds
+ */
+double benchNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Reads the file into memory, one heap string per line, with newlines removed
+ */
+int benchLoadFile(const char *filename, benchFile_s *file)
+{
+    FILE *fp = fopen(filename, "r");
+    if (!fp) return -1;
+
+    int capacity = 1024;
+    file->lines = malloc(sizeof(*file->lines) * capacity);
+    file->lineLens = malloc(sizeof(*file->lineLens) * capacity);
+    file->numLines = 0;
+
+    char *line = NULL;
+    size_t bufferSize = 0;
+    ssize_t lineLen = 0;
+    while ((lineLen = getline(&line, &bufferSize, fp)) != -1)
+    {
+        while (lineLen > 0 && (line[lineLen - 1] == '\n' || line[lineLen - 1] == '\r')) lineLen--;
+
+        if (file->numLines == capacity)
+        {
+            capacity *= 2;
+            file->lines = realloc(file->lines, sizeof(*file->lines) * capacity);
+            file->lineLens = realloc(file->lineLens, sizeof(*file->lineLens) * capacity);
+        }
+
+        file->lines[file->numLines] = strndup(line, lineLen);
+        file->lineLens[file->numLines] = lineLen;
+        file->numLines++;
+    }
+
+    free(line);
+    fclose(fp);
+
+    return 0;
+}
+
+void benchFreeFile(benchFile_s *file)
+{
+    for (int i = 0; i < file->numLines; i++) free(file->lines[i]);
+    free(file->lines);
+    free(file->lineLens);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s <benchmark|all> <file>\n", prog);
+    fprintf(stderr, "benchmarks:");
+    for (size_t i = 0; i < ARRAY_SIZE(benchmarks); i++)
+    {
+        fprintf(stderr, " %s", benchmarks[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    benchFile_s file;
+    if (benchLoadFile(argv[2], &file) == -1)
+    {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    int ran = 0;
+    int ret = EXIT_SUCCESS;
+    for (size_t i = 0; i < ARRAY_SIZE(benchmarks); i++)
+    {
+        if (strcmp(argv[1], "all") != 0 && strcmp(argv[1], benchmarks[i].name) != 0) continue;
+
+        printf("== %s (%s, %d lines)\n", benchmarks[i].name, argv[2], file.numLines);
+        if (benchmarks[i].func(&file) == -1) ret = EXIT_FAILURE;
+        ran++;
+    }
+
+    benchFreeFile(&file);
+
+    if (ran == 0)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    return ret;
+}
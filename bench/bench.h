@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+
+typedef struct
+{
+    char **lines;
+    int *lineLens;
+    int numLines;
+} benchFile_s;
+
+double benchNow();
+int benchLoadFile(const char *filename, benchFile_s *file);
+void benchFreeFile(benchFile_s *file);
+
+int benchFrame(benchFile_s *file);
+int benchKeywords(benchFile_s *file);
+int benchRegex(benchFile_s *file);
+int benchRender(benchFile_s *file);
@@ -0,0 +1,194 @@
+#include "bench.h"
+#include "astring.h"
+#include "document.h"
+#include "render.h"
+#include "screen.h"
+#include "syntax.h"
+#include "terminal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#define BENCH_ROWS      24
+#define BENCH_COLS      80
+#define BENCH_PASSES    200
+
+/*
+ * Copies the lines of the file into a document, the way ned holds them
+ */
+static document *benchDocument(benchFile_s *file)
+{
+    document *doc = docNew();
+    for (int i = 0; i < file->numLines; i++)
+    {
+        edRow_s *row = docInsertRow(doc, i);
+        docRowReserve(doc, row, file->lineLens[i]);
+        memcpy(row->string, file->lines[i], file->lineLens[i]);
+        row->size = file->lineLens[i];
+        docRowChanged(doc, row);
+    }
+
+    return doc;
+}
+
+/*
+ * Draws the rows starting at offset into the screen, with the code edDrawRows uses
+ */
+static void benchDrawRows(screen *scr, document *doc, int offset)
+{
+    for (int y = 0; y < BENCH_ROWS; y++)
+    {
+        astring *line = screenLine(scr, y);
+        int row = offset + y;
+        if (row < docNumRows(doc)) renderDraw(docGetRow(doc, row), 0, BENCH_COLS, line);
+        else astringAppend(line, "~", 1);
+    }
+}
+
+/*
+ * Scrolls through the whole file one line per frame, BENCH_PASSES times, the way edRefreshScreen
+ * draws and sends the frames. Returns the average time per frame in nanoseconds.
+ */
+static double benchScroll(document *doc, bool reuse, long *bytes)
+{
+    screen *scr = screenNew(BENCH_ROWS, BENCH_COLS);
+    astring *frame = astringNew();
+    long frames = 0;
+    int drawnOffset = 0;
+    *bytes = 0;
+
+    double start = benchNow();
+    for (int pass = 0; pass < BENCH_PASSES; pass++)
+    {
+        for (int offset = 0; offset < docNumRows(doc); offset++)
+        {
+            if (reuse)
+            {
+                astringClear(frame);
+            }
+            else
+            {
+                astringFree(&frame);
+                frame = astringNew();
+            }
+
+            screenScroll(scr, 0, BENCH_ROWS, offset - drawnOffset);
+            drawnOffset = offset;
+            benchDrawRows(scr, doc, offset);
+            astringAppend(frame, CURSOR_HIDE_CMD, CURSOR_HIDE_LEN);
+            screenRender(scr, frame);
+            astringAppend(frame, CURSOR_SHOW_CMD, CURSOR_SHOW_LEN);
+
+            *bytes += astringGetLen(frame);
+            frames++;
+        }
+    }
+    double elapsed = benchNow() - start;
+
+    astringFree(&frame);
+    screenFree(&scr);
+
+    return elapsed * 1e9 / frames;
+}
+
+/*
+ * Sends every screen of the file as a full frame with its highlight colors, and returns the
+ * average bytes of a frame. The frames are drawn with the code ned uses, which only sends the
+ * changes of color.
+ */
+static long benchHighlightedFrames(document *doc)
+{
+    screen *scr = screenNew(BENCH_ROWS, BENCH_COLS);
+    astring *frame = astringNew();
+    long bytes = 0;
+    long frames = 0;
+
+    for (int offset = 0; offset < docNumRows(doc); offset += BENCH_ROWS)
+    {
+        astringClear(frame);
+        benchDrawRows(scr, doc, offset);
+        screenInvalidate(scr);
+        screenRender(scr, frame);
+
+        bytes += astringGetLen(frame);
+        frames++;
+    }
+
+    astringFree(&frame);
+    screenFree(&scr);
+
+    return frames ? bytes / frames : 0;
+}
+
+/*
+ * The same frames with every run of color in its own SGR sequence, followed by a reset, the way
+ * ned used to send them. Kept as the reference the frames drawn by ned are compared to.
+ */
+static long benchPerRunFrames(benchFile_s *file)
+{
+    astring *frame = astringNew();
+    unsigned char *hl = malloc(BENCH_COLS);
+    assert(hl != NULL);
+    long bytes = 0;
+    long frames = 0;
+
+    for (int offset = 0; offset < file->numLines; offset += BENCH_ROWS)
+    {
+        astringClear(frame);
+        for (int y = 0; y < BENCH_ROWS; y++)
+        {
+            char cursorPos[32];
+            int cursorPosLen = snprintf(cursorPos, sizeof(cursorPos), "\x1b[%d;1H", y + 1);
+            astringAppend(frame, cursorPos, cursorPosLen);
+
+            int row = offset + y;
+            if (row >= file->numLines) continue;
+
+            int len = (file->lineLens[row] > BENCH_COLS) ? BENCH_COLS : file->lineLens[row];
+            const char *text = file->lines[row];
+            synHighlight(text, len, hl);
+
+            for (int start = 0, end; start < len; start = end)
+            {
+                for (end = start + 1; end < len && hl[end] == hl[start]; end++);
+
+                const char *colorStr = termGetColor(hl[start]);
+                astringAppend(frame, colorStr, strlen(colorStr));
+                astringAppend(frame, &text[start], end - start);
+                if (hl[start] != TERM_COLOR_NONE) astringAppend(frame, FG_COLOR_RESET, FG_COLOR_RESET_SIZE);
+            }
+            astringAppend(frame, DISPLAY_ERASE_LINE_CMD, DISPLAY_ERASE_LINE_LEN);
+        }
+
+        bytes += astringGetLen(frame);
+        frames++;
+    }
+
+    free(hl);
+    astringFree(&frame);
+
+    return frames ? bytes / frames : 0;
+}
+
+int benchFrame(benchFile_s *file)
+{
+    document *doc = benchDocument(file);
+    renderCacheResize(BENCH_ROWS);
+    long bytes = 0;
+
+    double fresh = benchScroll(doc, false, &bytes);
+    printf("new buffer per frame:    %8.0f ns/frame\n", fresh);
+
+    double reused = benchScroll(doc, true, &bytes);
+    printf("reused frame buffer:     %8.0f ns/frame\n", reused);
+    printf("frame size:              %8ld bytes/frame\n", bytes / ((long) docNumRows(doc) * BENCH_PASSES));
+
+    printf("highlighted, per run:    %8ld bytes/frame\n", benchPerRunFrames(file));
+    printf("highlighted, coalesced:  %8ld bytes/frame\n", benchHighlightedFrames(doc));
+
+    docFree(&doc);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "bench.h"
+#include "syntax.h"
+#include "keywords.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#define BENCH_PASSES 2000
+
+typedef termColor_e (*lookupFunc)(const char *, int);
+
+/*
+ * The lookup synGetKeyword used before the perfect hash: one string compare per keyword
+ */
+static termColor_e benchLinearLookup(const char *tok, int len)
+{
+    for (int i = 0; i < SYN_KEYWORD_SLOTS; i++)
+    {
+        const struct keyword *keyword = &synKeywords[i];
+        if (keyword->key == NULL) continue;
+        if (strncmp(tok, keyword->key, len) == 0 && keyword->key[len] == '\0') return keyword->color;
+    }
+
+    return TERM_COLOR_NONE;
+}
+
+static inline int benchIsIdentChar(char c)
+{
+    return isalnum((unsigned char) c) || c == '_';
+}
+
+/*
+ * Runs the lookup on every identifier in the file, BENCH_PASSES times.
+ * Returns the number of tokens per second.
+ */
+static double benchLookup(benchFile_s *file, lookupFunc lookup, long *matches)
+{
+    long tokens = 0;
+    *matches = 0;
+
+    double start = benchNow();
+    for (int pass = 0; pass < BENCH_PASSES; pass++)
+    {
+        for (int row = 0; row < file->numLines; row++)
+        {
+            const char *line = file->lines[row];
+            int len = file->lineLens[row];
+            int i = 0;
+            while (i < len)
+            {
+                if (!benchIsIdentChar(line[i]))
+                {
+                    i++;
+                    continue;
+                }
+
+                int tokStart = i;
+                while (i < len && benchIsIdentChar(line[i])) i++;
+                if (lookup(&line[tokStart], i - tokStart) != TERM_COLOR_NONE) (*matches)++;
+                tokens++;
+            }
+        }
+    }
+    double elapsed = benchNow() - start;
+
+    return tokens / elapsed;
+}
+
+int benchKeywords(benchFile_s *file)
+{
+    long linearMatches = 0;
+    long hashMatches = 0;
+
+    double linear = benchLookup(file, benchLinearLookup, &linearMatches);
+    printf("linear scan (%d keywords): %8.2f Mtokens/s\n", SYN_KEYWORD_COUNT, linear / 1e6);
+
+    double hash = benchLookup(file, synGetKeyword, &hashMatches);
+    printf("perfect hash:               %8.2f Mtokens/s\n", hash / 1e6);
+
+    if (linearMatches != hashMatches)
+    {
+        printf("mismatch: linear scan found %ld keywords, perfect hash found %ld\n", linearMatches, hashMatches);
+        return -1;
+    }
+
+    return 0;
+}
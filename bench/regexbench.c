@@ -0,0 +1,100 @@
+#include "bench.h"
+#include "regexp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_PATHOLOGICAL_LEN (1024 * 1024)
+
+struct pathological
+{
+    const char *pattern;
+    char fill;          // the line is made of this character
+    bool match;
+};
+
+/*
+ * Patterns that take exponential time in a backtracking matcher, on a line where they fail
+ * (or only succeed) at the very end. They must all run in time linear in the line length.
+ */
+static const struct pathological pathological[] =
+{
+    { "(a*)*b", 'a', false },
+    { "(a|aa)*c", 'a', false },
+    { "(x+x+)+y", 'x', false },
+    { "(.*){20}z", 'a', false },
+    { "(a|b)*a(a|b){15}c", 'a', false },
+    { "^(a+)+$", 'a', true },
+};
+
+static const char *patterns[] =
+{
+    "int",
+    "line [0-9]+",
+    "\\w+\\s*=\\s*\\d+;$",
+    "^(static|const) ",
+    "(foo|bar|baz)+qux",
+};
+
+int benchRegex(benchFile_s *file)
+{
+    int ret = 0;
+
+    char *line = malloc(BENCH_PATHOLOGICAL_LEN);
+    for (size_t i = 0; i < sizeof(pathological) / sizeof(pathological[0]); i++)
+    {
+        const struct pathological *p = &pathological[i];
+        memset(line, p->fill, BENCH_PATHOLOGICAL_LEN);
+
+        regexp *re = regexpCompile(p->pattern, NULL);
+        int start, end;
+        double t = benchNow();
+        bool match = regexpFind(re, line, BENCH_PATHOLOGICAL_LEN, 0, &start, &end);
+        t = benchNow() - t;
+        regexpFree(&re);
+
+        printf("%-24s %8.2f MB/s\n", p->pattern, BENCH_PATHOLOGICAL_LEN / t / 1e6);
+        if (match != p->match)
+        {
+            printf("wrong result for %s: %s\n", p->pattern, match ? "match" : "no match");
+            ret = -1;
+        }
+    }
+    free(line);
+
+    long bytes = 0;
+    for (int row = 0; row < file->numLines; row++) bytes += file->lineLens[row];
+
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++)
+    {
+        const char *error = NULL;
+        regexp *re = regexpCompile(patterns[i], &error);
+        if (re == NULL)
+        {
+            printf("%s: %s\n", patterns[i], error);
+            ret = -1;
+            continue;
+        }
+
+        // every match in the file, like repeated searches would find them
+        long matches = 0;
+        double t = benchNow();
+        for (int row = 0; row < file->numLines; row++)
+        {
+            int from = 0;
+            int start, end;
+            while (regexpFind(re, file->lines[row], file->lineLens[row], from, &start, &end))
+            {
+                matches++;
+                from = start + 1;
+            }
+        }
+        t = benchNow() - t;
+        regexpFree(&re);
+
+        printf("%-24s %8.2f MB/s, %ld matches\n", patterns[i], bytes / t / 1e6, matches);
+    }
+
+    return ret;
+}
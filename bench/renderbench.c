@@ -0,0 +1,107 @@
+#include "bench.h"
+#include "render.h"
+#include "syntax.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#define BENCH_PASSES 200
+
+/*
+ * The render ned used before it knew about UTF-8: one byte per column, tabs expanded byte by byte
+ */
+static int benchBytewiseRender(const char *line, int len, char *out, unsigned char *hl)
+{
+    int rx = 0;
+    for (int i = 0; i < len; i++)
+    {
+        if (line[i] == '\t')
+        {
+            do out[rx++] = ' '; while (rx % RENDER_TAB_STOP != 0);
+        }
+        else
+        {
+            out[rx++] = line[i];
+        }
+    }
+
+    synHighlight(out, rx, hl);
+    return rx;
+}
+
+static bool benchIsAscii(const char *line, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        if ((unsigned char) line[i] >= 0x80) return false;
+    }
+
+    return true;
+}
+
+int benchRender(benchFile_s *file)
+{
+    long bytes = 0;
+    int maxLen = 0;
+    for (int i = 0; i < file->numLines; i++)
+    {
+        bytes += file->lineLens[i];
+        if (file->lineLens[i] > maxLen) maxLen = file->lineLens[i];
+    }
+
+    char *out = malloc((size_t) maxLen * RENDER_TAB_STOP + 1);
+    unsigned char *hl = malloc((size_t) maxLen * RENDER_TAB_STOP + 1);
+    assert(out != NULL && hl != NULL);
+
+    double start = benchNow();
+    for (int pass = 0; pass < BENCH_PASSES; pass++)
+    {
+        for (int i = 0; i < file->numLines; i++) benchBytewiseRender(file->lines[i], file->lineLens[i], out, hl);
+    }
+    double bytewise = benchNow() - start;
+    printf("byte-wise render:   %8.2f MB/s\n", bytes * (double) BENCH_PASSES / bytewise / 1e6);
+
+    // the rows are rendered again on every pass, into the buffers of the render cache
+    edRow_s *rows = calloc(file->numLines, sizeof(edRow_s));
+    assert(rows != NULL);
+    for (int i = 0; i < file->numLines; i++)
+    {
+        rows[i].string = file->lines[i];
+        rows[i].size = file->lineLens[i];
+    }
+
+    start = benchNow();
+    for (int pass = 0; pass < BENCH_PASSES; pass++)
+    {
+        for (int i = 0; i < file->numLines; i++) renderRow(&rows[i]);
+    }
+    double utf8 = benchNow() - start;
+    printf("UTF-8 aware render: %8.2f MB/s\n", bytes * (double) BENCH_PASSES / utf8 / 1e6);
+
+    int ret = 0;
+    for (int i = 0; i < file->numLines; i++)
+    {
+        edRow_s *row = &rows[i];
+        if (ret == 0 && benchIsAscii(file->lines[i], file->lineLens[i]))
+        {
+            int len = benchBytewiseRender(file->lines[i], file->lineLens[i], out, hl);
+            int renderLen, pad;
+            const unsigned char *renderHl;
+            const char *render = renderSlice(row, 0, INT_MAX, &renderLen, &pad, &renderHl);
+            if (len != renderLen || memcmp(out, render, len) != 0 || memcmp(hl, renderHl, len) != 0)
+            {
+                printf("mismatch: line %d renders differently\n", i + 1);
+                ret = -1;
+            }
+        }
+    }
+
+    free(rows);
+    free(out);
+    free(hl);
+    return ret;
+}
@@ -1,19 +1,10 @@
 workspace "ned"
-    configurations { "Debug", "Release", "ASAN", "MSAN" }
-
-project "ned"
-    kind "ConsoleApp"
+    configurations { "Debug", "Release", "ASAN", "MSAN", "Bench" }
     language "C"
     cdialect "gnu11"
     targetdir "build/%{cfg.buildcfg}"
     toolset "clang"
 
-    files
-    {
-        "src/**.h",
-        "src/**.c",
-    }
-
     filter "system:linux"
         buildoptions
         {
@@ -45,3 +36,141 @@ project "ned"
 
     filter "configurations:Release"
         optimize "On"
+
+    -- like Release, but counts allocations for the replay statistics
+    filter "configurations:Bench"
+        optimize "On"
+        defines { "NED_COUNT_ALLOCS" }
+
+    filter {}
+
+-- src/syntax.c includes the keyword table that kwgen generates from src/keywords.txt
+function keywordTable()
+    dependson { "kwgen" }
+    includedirs { "src", "build/gen" }
+
+    prebuildcommands
+    {
+        "{MKDIR} %{wks.location}/build/gen",
+        "%{wks.location}/build/%{cfg.buildcfg}/kwgen %{wks.location}/src/keywords.txt %{wks.location}/build/gen/keywords.h",
+    }
+end
+
+project "kwgen"
+    kind "ConsoleApp"
+    includedirs { "src" }
+
+    files
+    {
+        "tools/kwgen.c",
+        "src/synhash.h",
+    }
+
+project "ned"
+    kind "ConsoleApp"
+    keywordTable()
+    links { "pthread" }
+
+    files
+    {
+        "src/**.h",
+        "src/**.c",
+    }
+
+-- micro-benchmarks for the hot paths, run with e.g. build/Release/nedbench frame tests/largefile
+project "nedbench"
+    kind "ConsoleApp"
+    includedirs { "src" }
+    keywordTable()
+    links { "pthread" }
+
+    files
+    {
+        "bench/**.h",
+        "bench/**.c",
+        "src/astring.h",
+        "src/astring.c",
+        "src/syntax.h",
+        "src/syntax.c",
+        "src/regexp.h",
+        "src/regexp.c",
+        "src/render.h",
+        "src/render.c",
+        "src/utf8.h",
+        "src/utf8.c",
+        "src/document.h",
+        "src/document.c",
+        "src/slab.h",
+        "src/slab.c",
+        "src/screen.h",
+        "src/screen.c",
+        "src/terminal.h",
+        "src/terminal.c",
+        "src/utils.h",
+        "src/utils.c",
+    }
+
+-- unit tests, run with build/Debug/nedtest [test names]
+project "nedtest"
+    kind "ConsoleApp"
+    includedirs { "src" }
+    keywordTable()
+    links { "pthread", "util" }
+
+    files
+    {
+        "tests/**.h",
+        "tests/**.c",
+        "src/astring.h",
+        "src/astring.c",
+        "src/document.h",
+        "src/document.c",
+        "src/slab.h",
+        "src/slab.c",
+        "src/regexp.h",
+        "src/regexp.c",
+        "src/syntax.h",
+        "src/syntax.c",
+        "src/terminal.h",
+        "src/terminal.c",
+        "src/undo.h",
+        "src/undo.c",
+        "src/utils.h",
+        "src/utils.c",
+    }
+
+-- replays the key scripts in bench/scenarios with a headless ned, on copies of the test files.
+-- Build the Bench configuration first, then run: premake5 replay
+newaction
+{
+    trigger = "replay",
+    description = "Run the headless replay scenarios and report key latencies",
+
+    execute = function ()
+        local ned = "build/Bench/ned"
+        if not os.isfile(ned) then
+            print(ned .. " not found, build the Bench configuration first")
+            os.exit(1)
+        end
+
+        os.mkdir("build/replay")
+        local synthetic = "build/replay/synthetic-1m"
+        if not os.isfile(synthetic) then
+            local f = io.open(synthetic, "w")
+            for i = 1, 1000000 do
+                f:write(string.format("line %d: int x%d = %d; // some text to search through\n", i, i, i))
+            end
+            f:close()
+        end
+
+        for _, scenario in ipairs(os.matchfiles("bench/scenarios/*.keys")) do
+            for _, input in ipairs({ "tests/largefile", synthetic }) do
+                -- scenarios may save, so they never run on the original
+                local copy = "build/replay/" .. path.getname(input) .. ".copy"
+                os.copyfile(input, copy)
+                print("== " .. path.getbasename(scenario) .. " (" .. input .. ")")
+                os.execute(ned .. " --replay " .. scenario .. " " .. copy)
+            end
+        end
+    end
+}
@@ -0,0 +1,59 @@
+#include "alloccount.h"
+
+#include <stdatomic.h>
+
+/*
+ * Counts heap allocations, for the replay statistics. Only built with NED_COUNT_ALLOCS (the Bench
+ * configuration), where malloc, calloc and realloc are replaced by wrappers around the glibc
+ * allocator. That also catches the allocations made inside libc, like strdup.
+ */
+
+#ifdef NED_COUNT_ALLOCS
+
+static atomic_size_t allocations;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t num, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+bool allocCountEnabled()
+{
+    return true;
+}
+
+size_t allocCount()
+{
+    return atomic_load_explicit(&allocations, memory_order_relaxed);
+}
+
+#else
+
+bool allocCountEnabled()
+{
+    return false;
+}
+
+size_t allocCount()
+{
+    return 0;
+}
+
+#endif
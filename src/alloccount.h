@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+bool allocCountEnabled();
+size_t allocCount();
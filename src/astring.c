@@ -3,10 +3,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define ASTRING_MIN_CAPACITY 128
+
 struct astring_s
 {
     char *buf;
     int len;
+    int capacity;
 };
 
 astring* astringNew()
@@ -14,19 +17,38 @@ astring* astringNew()
     astring *astr = malloc(sizeof(*astr));
     astr->buf = NULL;
     astr->len = 0;
+    astr->capacity = 0;
 
     return astr;
 }
 
-int astringAppend(astring *astr, const char *text, int len)
+/*
+ * Makes sure there is room for at least size bytes, without changing the contents
+ */
+int astringReserve(astring *astr, int size)
 {
-    // TODO(noxet): make this more efficient, e.g. start with size 1000 and double when we fill it
-    char *newBuf = realloc(astr->buf, astr->len + len);
-    if (!newBuf) return -1;
+    if (size <= astr->capacity) return 0;
 
-    memcpy(&newBuf[astr->len], text, len);
+    char *newBuf = realloc(astr->buf, size);
+    if (!newBuf) return -1;
 
     astr->buf = newBuf;
+    astr->capacity = size;
+
+    return 0;
+}
+
+int astringAppend(astring *astr, const char *text, int len)
+{
+    if (astr->len + len > astr->capacity)
+    {
+        // grow geometrically, so appending n bytes costs O(log n) reallocations in total
+        int newCapacity = astr->capacity ? astr->capacity * 2 : ASTRING_MIN_CAPACITY;
+        while (newCapacity < astr->len + len) newCapacity *= 2;
+        if (astringReserve(astr, newCapacity) == -1) return -1;
+    }
+
+    memcpy(&astr->buf[astr->len], text, len);
     astr->len += len;
 
     return 0;
@@ -42,6 +64,14 @@ int astringGetLen(astring *astr)
     return astr->len;
 }
 
+/*
+ * Empties the string but keeps the buffer, so it can be filled again without allocating
+ */
+void astringClear(astring *astr)
+{
+    astr->len = 0;
+}
+
 void astringFree(astring **astr)
 {
     free((*astr)->buf);
@@ -2,11 +2,13 @@
 
 typedef struct astring_s astring;
 
-#define NEW_STRING {NULL, 0}
+#define NEW_STRING {NULL, 0, 0}
 
 astring* astringNew();
+int astringReserve(astring *astr, int size);
 int astringAppend(astring *astr, const char *text, int len);
 const char *astringGetString(astring *astr);
 int astringGetLen(astring *astr);
+void astringClear(astring *astr);
 void astringFree(astring **astr);
 
@@ -0,0 +1,654 @@
+#define _DEFAULT_SOURCE
+
+#include "document.h"
+#include "slab.h"
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <libgen.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define DOC_INITIAL_CAPACITY 64
+#define DOC_SAVE_IOVECS 1024    // iovecs per writev, two per row
+
+static mode_t docUmask;         // the process umask, for files that are saved for the first time
+static bool docUmaskRead = false;
+
+/*
+ * The rows are stored in a gap buffer. Rows [0, gapStart) live at the start of the array,
+ * the rest of the rows live at the end of the array, after gapEnd. Inserting or deleting a row
+ * moves the gap to that position first, so a series of edits close to each other (which is what
+ * typing looks like) only moves a handful of rows, no matter how large the file is.
+ *
+ * The byte offset of every row is kept in a Fenwick tree over the slots of the array, where each
+ * slot weighs the size of its row plus the line ending, and the slots in the gap weigh nothing.
+ * Finding the offset of a row, or the row at an offset, takes O(log n), and so does updating it
+ * after an edit. Moving the gap moves the weights along with the rows.
+ *
+ * The offsets are those of the file as it is saved, with a single '\n' per row: the '\r' of
+ * CRLF line endings is stripped at load and not counted.
+ */
+struct document_s
+{
+    edRow_s *rows;
+    int capacity;
+    int gapStart;
+    int gapEnd;
+
+    size_t *offsets;    // Fenwick tree, 1-based, with capacity entries
+    bool offsetsValid;  // false while loading a file, the tree is built once at the end
+
+    // read-only mapping of the opened file. Unedited rows point straight into it
+    char *map;
+    size_t mapSize;
+
+    slab *text;         // the text of edited rows, released all at once with the document
+};
+
+/*
+ * The text of an edited row, in a block of the document's slab. A snapshot shares the text with
+ * the row instead of copying it, and the row makes its own copy the next time it is edited
+ * (see docRowReserve).
+ */
+typedef struct
+{
+    atomic_int refs;
+    size_t blockSize;
+    char data[];
+} docText_s;
+
+typedef struct
+{
+    const char *string;
+    int size;
+    docText_s *text;    // NULL if the row points into the mapped file
+} docSnapshotRow_s;
+
+/*
+ * The rows of a document at one point in time, which can be saved while the document changes
+ */
+struct docSnapshot_s
+{
+    slab *text;         // of the document, which outlives the snapshot
+    docSnapshotRow_s *rows;
+    int numRows;
+    size_t size;        // bytes in the saved file
+    atomic_size_t written;
+};
+
+
+static inline int docGapSize(document *doc)
+{
+    return doc->gapEnd - doc->gapStart;
+}
+
+static inline size_t docSlotWeight(document *doc, int slot)
+{
+    if (slot >= doc->gapStart && slot < doc->gapEnd) return 0;
+    return doc->rows[slot].size + 1;
+}
+
+/*
+ * Adds delta to the weight of a slot. The sums are unsigned, a negative delta wraps around.
+ */
+static void docOffsetsAdd(document *doc, int slot, size_t delta)
+{
+    if (!doc->offsetsValid) return;
+    for (int i = slot + 1; i <= doc->capacity; i += i & -i) doc->offsets[i] += delta;
+}
+
+/*
+ * Sum of the weights of the slots before slot
+ */
+static size_t docOffsetsPrefix(document *doc, int slot)
+{
+    size_t sum = 0;
+    for (int i = slot; i > 0; i -= i & -i) sum += doc->offsets[i];
+    return sum;
+}
+
+static void docOffsetsBuild(document *doc)
+{
+    free(doc->offsets);
+    doc->offsets = calloc(doc->capacity + 1, sizeof(*doc->offsets));
+    assert(doc->offsets != NULL || doc->capacity == 0);
+
+    for (int i = 1; i <= doc->capacity; i++)
+    {
+        doc->offsets[i] += docSlotWeight(doc, i - 1);
+        int parent = i + (i & -i);
+        if (parent <= doc->capacity) doc->offsets[parent] += doc->offsets[i];
+    }
+
+    doc->offsetsValid = true;
+}
+
+static inline int docSlot(document *doc, int at)
+{
+    return (at < doc->gapStart) ? at : at + docGapSize(doc);
+}
+
+static void docMoveGap(document *doc, int at)
+{
+    int count = abs(at - doc->gapStart);
+    if (count == 0) return;
+
+    // the slots the rows move from and to
+    int from = (at < doc->gapStart) ? at : doc->gapEnd;
+    int to = (at < doc->gapStart) ? doc->gapEnd - count : doc->gapStart;
+
+    // moving many rows, it is cheaper to build the offsets again than to move every weight
+    bool rebuild = count > doc->capacity / 32;
+    if (!rebuild)
+    {
+        for (int i = 0; i < count; i++) docOffsetsAdd(doc, from + i, -docSlotWeight(doc, from + i));
+    }
+
+    memmove(&doc->rows[to], &doc->rows[from], sizeof(edRow_s) * count);
+    if (at < doc->gapStart)
+    {
+        doc->gapStart -= count;
+        doc->gapEnd -= count;
+    }
+    else
+    {
+        doc->gapStart += count;
+        doc->gapEnd += count;
+    }
+
+    if (rebuild)
+    {
+        if (doc->offsetsValid) docOffsetsBuild(doc);
+        return;
+    }
+
+    for (int i = 0; i < count; i++) docOffsetsAdd(doc, to + i, docSlotWeight(doc, to + i));
+}
+
+static void docGrow(document *doc)
+{
+    int newCapacity = doc->capacity ? doc->capacity * 2 : DOC_INITIAL_CAPACITY;
+    edRow_s *newRows = realloc(doc->rows, sizeof(edRow_s) * newCapacity);
+    assert(newRows != NULL);
+
+    // move the tail to the end of the new array, widening the gap
+    int tailLen = doc->capacity - doc->gapEnd;
+    int newGapEnd = newCapacity - tailLen;
+    memmove(&newRows[newGapEnd], &newRows[doc->gapEnd], sizeof(edRow_s) * tailLen);
+
+    doc->rows = newRows;
+    doc->gapEnd = newGapEnd;
+    doc->capacity = newCapacity;
+
+    // the tree has a fixed size, it is built again for the new slots
+    if (doc->offsetsValid) docOffsetsBuild(doc);
+}
+
+static inline docText_s *docRowText(edRow_s *row)
+{
+    return (docText_s *) (row->string - offsetof(docText_s, data));
+}
+
+static void docTextUnref(slab *s, docText_s *text)
+{
+    if (atomic_fetch_sub(&text->refs, 1) == 1) slabRelease(s, text, text->blockSize);
+}
+
+static void docFreeRow(document *doc, edRow_s *row)
+{
+    if (row->capacity) docTextUnref(doc->text, docRowText(row));
+}
+
+
+document *docNew()
+{
+    // the umask can only be read by setting it, which would affect files other threads create
+    // at the same time, so it is read once here, before any save runs
+    if (!docUmaskRead)
+    {
+        docUmask = umask(0);
+        umask(docUmask);
+        docUmaskRead = true;
+    }
+
+    document *doc = malloc(sizeof(*doc));
+    assert(doc != NULL);
+    doc->rows = NULL;
+    doc->capacity = 0;
+    doc->gapStart = 0;
+    doc->gapEnd = 0;
+    doc->map = NULL;
+    doc->mapSize = 0;
+    doc->offsets = NULL;
+    doc->offsetsValid = true;
+    doc->text = slabNew();
+
+    return doc;
+}
+
+void docFree(document **doc)
+{
+    if (*doc == NULL) return;
+
+    slabFree(&(*doc)->text);
+    if ((*doc)->map) munmap((*doc)->map, (*doc)->mapSize);
+    free((*doc)->rows);
+    free((*doc)->offsets);
+    free(*doc);
+    *doc = NULL;
+}
+
+/*
+ * Maps the file into memory and creates one row per line, pointing into the mapping.
+ * Nothing is copied until a row is edited, see docRowReserve.
+ */
+int docLoadFile(document *doc, const char *filename)
+{
+    assert(doc->map == NULL && docNumRows(doc) == 0);
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) return -1;
+
+    struct stat sb;
+    if (fstat(fd, &sb) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    // mmap refuses empty mappings, an empty file simply has no rows
+    if (sb.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    char *map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    madvise(map, sb.st_size, MADV_SEQUENTIAL);
+
+    doc->map = map;
+    doc->mapSize = sb.st_size;
+    doc->offsetsValid = false;
+
+    char *p = map;
+    char *end = map + sb.st_size;
+    while (p < end)
+    {
+        char *nl = memchr(p, '\n', end - p);
+        char *next = nl ? nl + 1 : end;
+        if (!nl) nl = end;
+
+        // remove newline char(s) if present
+        while (nl > p && nl[-1] == '\r') nl--;
+
+        edRow_s *row = docInsertRow(doc, docNumRows(doc));
+        row->string = p;
+        row->size = nl - p;
+
+        p = next;
+    }
+
+    // the rows are now mostly accessed around the cursor
+    madvise(map, sb.st_size, MADV_NORMAL);
+    docOffsetsBuild(doc);
+
+    return 0;
+}
+
+int docNumRows(document *doc)
+{
+    return doc->capacity - docGapSize(doc);
+}
+
+/*
+ * Returns the row at the given index. The pointer is only valid until the next call to
+ * docInsertRow or docDeleteRow, since these move rows around in memory.
+ */
+edRow_s *docGetRow(document *doc, int at)
+{
+    assert(at >= 0 && at < docNumRows(doc));
+    return &doc->rows[docSlot(doc, at)];
+}
+
+/*
+ * Inserts an empty row at the given index and returns it, for the caller to fill in.
+ */
+edRow_s *docInsertRow(document *doc, int at)
+{
+    assert(at >= 0 && at <= docNumRows(doc));
+    if (docGapSize(doc) == 0) docGrow(doc);
+    docMoveGap(doc, at);
+
+    edRow_s *row = &doc->rows[doc->gapStart++];
+    memset(row, 0, sizeof(*row));
+    // an empty row still has its line ending
+    docOffsetsAdd(doc, doc->gapStart - 1, 1);
+
+    return row;
+}
+
+/*
+ * Removes the row at the given index and frees its memory.
+ */
+void docDeleteRow(document *doc, int at)
+{
+    assert(at >= 0 && at < docNumRows(doc));
+    docMoveGap(doc, at);
+    docOffsetsAdd(doc, doc->gapEnd, -docSlotWeight(doc, doc->gapEnd));
+    docFreeRow(doc, &doc->rows[doc->gapEnd++]);
+}
+
+/*
+ * Updates the offsets after the size of the row changed
+ */
+void docRowChanged(document *doc, edRow_s *row)
+{
+    int slot = row - doc->rows;
+    assert(slot >= 0 && slot < doc->capacity);
+    size_t weight = docOffsetsPrefix(doc, slot + 1) - docOffsetsPrefix(doc, slot);
+    docOffsetsAdd(doc, slot, docSlotWeight(doc, slot) - weight);
+}
+
+/*
+ * Size of the document in bytes, counting one '\n' per row
+ */
+size_t docSize(document *doc)
+{
+    return docOffsetsPrefix(doc, doc->capacity);
+}
+
+/*
+ * Byte offset where the row starts
+ */
+size_t docRowOffset(document *doc, int at)
+{
+    assert(at >= 0 && at <= docNumRows(doc));
+    if (at == docNumRows(doc)) return docSize(doc);
+    return docOffsetsPrefix(doc, docSlot(doc, at));
+}
+
+/*
+ * Returns the row that contains the byte offset. Offsets past the end give the last row.
+ */
+int docRowAtOffset(document *doc, size_t offset)
+{
+    int numRows = docNumRows(doc);
+    if (numRows == 0) return 0;
+    if (offset >= docSize(doc)) return numRows - 1;
+
+    // walk down the tree, to the last slot whose prefix sum does not exceed the offset
+    int slot = 0;
+    int step = 1;
+    while (step * 2 <= doc->capacity) step *= 2;
+    for (; step > 0; step /= 2)
+    {
+        if (slot + step <= doc->capacity && doc->offsets[slot + step] <= offset)
+        {
+            slot += step;
+            offset -= doc->offsets[slot];
+        }
+    }
+
+    // the slot found holds a row, empty slots in the gap are skipped over
+    return (slot < doc->gapStart) ? slot : slot - docGapSize(doc);
+}
+
+/*
+ * Makes sure the row owns a NULL-terminated buffer with room for size characters, copying the
+ * text out of the mapped file the first time the row is edited, or out of the buffer it shares
+ * with a snapshot. The buffer has room to spare, so most edits fit without moving the text.
+ */
+void docRowReserve(document *doc, edRow_s *row, int size)
+{
+    bool shared = row->capacity && atomic_load(&docRowText(row)->refs) > 1;
+    if (!shared && row->capacity >= size + 1) return;
+
+    // a row that keeps growing gets half again as much room
+    size_t want = sizeof(docText_s) + (size_t) size + 1;
+    if (row->capacity && !shared) want += want / 2;
+
+    size_t blockSize;
+    docText_s *text = slabAlloc(doc->text, want, &blockSize);
+    atomic_init(&text->refs, 1);
+    text->blockSize = blockSize;
+    int len = (row->size < size) ? row->size : size;
+    if (len) memcpy(text->data, row->string, len);
+    text->data[len] = '\0';
+
+    if (row->capacity) docTextUnref(doc->text, docRowText(row));
+    row->string = text->data;
+    size_t capacity = blockSize - sizeof(docText_s);
+    row->capacity = (capacity > INT_MAX) ? INT_MAX : capacity;
+}
+
+/*
+ * Takes a snapshot of the rows. Edited rows are shared with the snapshot until they change again,
+ * rows from the mapped file are simply pointed to, so the document must outlive the snapshot.
+ */
+docSnapshot *docSnapshotNew(document *doc)
+{
+    docSnapshot *snap = malloc(sizeof(*snap));
+    assert(snap != NULL);
+    snap->numRows = docNumRows(doc);
+    snap->rows = malloc(sizeof(*snap->rows) * (snap->numRows ? snap->numRows : 1));
+    assert(snap->rows != NULL);
+    snap->size = 0;
+    snap->text = doc->text;
+    atomic_init(&snap->written, 0);
+
+    for (int i = 0; i < snap->numRows; i++)
+    {
+        edRow_s *row = docGetRow(doc, i);
+        docSnapshotRow_s *snapRow = &snap->rows[i];
+        snapRow->string = row->string;
+        snapRow->size = row->size;
+        snapRow->text = NULL;
+        if (row->capacity)
+        {
+            snapRow->text = docRowText(row);
+            atomic_fetch_add(&snapRow->text->refs, 1);
+        }
+
+        snap->size += row->size + 1;
+    }
+
+    return snap;
+}
+
+/*
+ * Can be called from any thread, to release the snapshot once it has been saved
+ */
+void docSnapshotFree(docSnapshot **snap)
+{
+    if (*snap == NULL) return;
+
+    for (int i = 0; i < (*snap)->numRows; i++)
+    {
+        if ((*snap)->rows[i].text) docTextUnref((*snap)->text, (*snap)->rows[i].text);
+    }
+
+    free((*snap)->rows);
+    free(*snap);
+    *snap = NULL;
+}
+
+size_t docSnapshotSize(docSnapshot *snap)
+{
+    return snap->size;
+}
+
+/*
+ * Bytes written so far by docSnapshotSave, which may be running on another thread
+ */
+size_t docSnapshotWritten(docSnapshot *snap)
+{
+    return atomic_load(&snap->written);
+}
+
+/*
+ * Writes all iovecs, continuing after partial writes
+ */
+static int docWriteAll(int fd, struct iovec *iov, int count)
+{
+    while (count > 0)
+    {
+        ssize_t written = writev(fd, iov, count);
+        if (written == -1)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        // skip what was written, the last iovec may be written partially
+        while (count > 0 && (size_t) written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+
+        if (count > 0)
+        {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    return 0;
+}
+
+static int docWriteRows(docSnapshot *snap, int fd)
+{
+    static char newline = '\n';
+    struct iovec iov[DOC_SAVE_IOVECS];
+    int count = 0;
+    size_t batchSize = 0;
+
+    for (int i = 0; i < snap->numRows; i++)
+    {
+        docSnapshotRow_s *row = &snap->rows[i];
+        iov[count++] = (struct iovec) { (char *) row->string, row->size };
+        iov[count++] = (struct iovec) { &newline, 1 };
+        batchSize += row->size + 1;
+
+        if (count == DOC_SAVE_IOVECS || i == snap->numRows - 1)
+        {
+            if (docWriteAll(fd, iov, count) == -1) return -1;
+            atomic_fetch_add(&snap->written, batchSize);
+            count = 0;
+            batchSize = 0;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Gives the new file the owner of the one it replaces. Only root can give a file to another user,
+ * then the group is kept if the user is a member of it. Returns false if neither could be kept,
+ * which is not an error: the file then belongs to whoever saved it.
+ */
+static bool docKeepOwner(int fd, struct stat *sb)
+{
+    return fchown(fd, sb->st_uid, sb->st_gid) == 0 || fchown(fd, -1, sb->st_gid) == 0;
+}
+
+/*
+ * Makes the rename durable, by syncing the directory the file lives in
+ */
+static void docSyncDir(const char *dir)
+{
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd == -1) return;
+    fsync(fd);
+    close(fd);
+}
+
+/*
+ * Saves the snapshot, one line per row. The rows are written straight from memory into a
+ * temporary file next to the target, which is synced to disk and then renamed over the target.
+ * The original file is left untouched until the new one is complete, so a failed or interrupted
+ * save never loses it. This also keeps the mapping of the original file valid for unedited rows.
+ * Returns -1 and sets errno on failure.
+ */
+int docSnapshotSave(docSnapshot *snap, const char *filename)
+{
+    // a symlink is followed, and the file it points to is replaced instead of the link
+    char *target = realpath(filename, NULL);
+    if (target) filename = target;
+
+    char *pathCopy = strdup(filename);
+    char *baseCopy = strdup(filename);
+    assert(pathCopy != NULL && baseCopy != NULL);
+    const char *dir = dirname(pathCopy);
+    char tmpName[PATH_MAX];
+    int len = snprintf(tmpName, sizeof(tmpName), "%s/.%s.XXXXXX", dir, basename(baseCopy));
+    free(baseCopy);
+    if (len >= (int) sizeof(tmpName))
+    {
+        free(pathCopy);
+        free(target);
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = mkstemp(tmpName);
+    if (fd == -1)
+    {
+        int err = errno;
+        free(pathCopy);
+        free(target);
+        errno = err;
+        return -1;
+    }
+
+    // keep the owner and permissions of the file we replace, mkstemp creates it private to the
+    // user. The owner is set first, since that clears the setuid and setgid bits.
+    struct stat sb;
+    mode_t mode = 0666 & ~docUmask;
+    if (stat(filename, &sb) == 0)
+    {
+        mode = sb.st_mode & 07777;
+        docKeepOwner(fd, &sb);
+    }
+
+    if (fchmod(fd, mode) == -1 || docWriteRows(snap, fd) == -1 || fsync(fd) == -1)
+    {
+        int err = errno;
+        close(fd);
+        unlink(tmpName);
+        free(pathCopy);
+        free(target);
+        errno = err;
+        return -1;
+    }
+
+    if (close(fd) == -1 || rename(tmpName, filename) == -1)
+    {
+        int err = errno;
+        unlink(tmpName);
+        free(pathCopy);
+        free(target);
+        errno = err;
+        return -1;
+    }
+
+    docSyncDir(dir);
+    free(pathCopy);
+    free(target);
+
+    return 0;
+}
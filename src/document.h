@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    char *string;       // not NULL-terminated when the row still points into the mapped file
+    int size;
+    int capacity;       // 0 if the string is not owned by the row
+    int renderSlot;     // of the render in the render cache
+    uint64_t renderStamp; // the render is the row's while the stamps match, 0 if never rendered
+} edRow_s;
+
+typedef struct document_s document;
+typedef struct docSnapshot_s docSnapshot;
+
+document *docNew();
+void docFree(document **doc);
+int docLoadFile(document *doc, const char *filename);
+int docNumRows(document *doc);
+edRow_s *docGetRow(document *doc, int at);
+edRow_s *docInsertRow(document *doc, int at);
+void docDeleteRow(document *doc, int at);
+void docRowReserve(document *doc, edRow_s *row, int size);
+void docRowChanged(document *doc, edRow_s *row);
+size_t docSize(document *doc);
+size_t docRowOffset(document *doc, int at);
+int docRowAtOffset(document *doc, size_t offset);
+docSnapshot *docSnapshotNew(document *doc);
+void docSnapshotFree(docSnapshot **snap);
+int docSnapshotSave(docSnapshot *snap, const char *filename);
+size_t docSnapshotSize(docSnapshot *snap);
+size_t docSnapshotWritten(docSnapshot *snap);
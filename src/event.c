@@ -0,0 +1,195 @@
+#define _GNU_SOURCE
+
+#include "event.h"
+#include "utils.h"
+#include "terminal.h"
+
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+
+#define EVENT_MAX_TIMERS 8
+
+/*
+ * Waits for input on stdin, signals, timers and wakeups from other threads, without polling.
+ * Signals and wakeups are written as single bytes to a self-pipe, which is drained on every
+ * wait, so any number of them pending at once is reported as one event.
+ */
+
+typedef struct
+{
+    bool active;
+    long long deadline;     // CLOCK_MONOTONIC, in ms
+    eventCallback callback;
+} eventTimer_s;
+
+static int eventPipe[2] = { -1, -1 };
+static eventTimer_s eventTimers[EVENT_MAX_TIMERS];
+
+
+static long long eventNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void eventSignal(int sig)
+{
+    int savedErrno = errno;
+    char ch = sig;
+    // if the pipe is full there is already an event pending
+    if (write(eventPipe[1], &ch, 1) == -1) {}
+    errno = savedErrno;
+}
+
+/*
+ * Creates the wake pipe and takes over SIGWINCH and SIGTERM
+ */
+int eventInit()
+{
+    if (pipe2(eventPipe, O_NONBLOCK | O_CLOEXEC) == -1) return -1;
+
+    struct sigaction sa = { 0 };
+    sa.sa_flags = SA_RESTART;
+    sa.sa_handler = eventSignal;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGWINCH, &sa, NULL) == -1) return -1;
+    if (sigaction(SIGTERM, &sa, NULL) == -1) return -1;
+
+    return 0;
+}
+
+/*
+ * Makes eventWait return. Safe to call from any thread.
+ */
+void eventWake()
+{
+    eventSignal(0);
+}
+
+/*
+ * Calls callback from eventWait once delayMs has passed. Returns the timer, or -1 if all are in use.
+ */
+int eventTimerStart(int delayMs, eventCallback callback)
+{
+    for (int i = 0; i < EVENT_MAX_TIMERS; i++)
+    {
+        if (eventTimers[i].active) continue;
+
+        eventTimers[i].active = true;
+        eventTimers[i].deadline = eventNow() + delayMs;
+        eventTimers[i].callback = callback;
+        return i;
+    }
+
+    return -1;
+}
+
+/*
+ * Stops a timer that has not fired yet, and sets it to -1
+ */
+void eventTimerStop(int *timer)
+{
+    if (*timer >= 0) eventTimers[*timer].active = false;
+    *timer = -1;
+}
+
+/*
+ * Runs the expired timers. Returns true if any fired, and sets timeoutMs to the time left until
+ * the next one, or -1 if none is active.
+ */
+static bool eventRunTimers(int *timeoutMs)
+{
+    long long now = eventNow();
+    long long next = -1;
+    bool fired = false;
+
+    for (int i = 0; i < EVENT_MAX_TIMERS; i++)
+    {
+        eventTimer_s *t = &eventTimers[i];
+        if (!t->active) continue;
+
+        if (t->deadline <= now)
+        {
+            // the callback may start the timer again
+            t->active = false;
+            t->callback();
+            fired = true;
+        }
+    }
+
+    for (int i = 0; i < EVENT_MAX_TIMERS; i++)
+    {
+        if (eventTimers[i].active && (next == -1 || eventTimers[i].deadline < next)) next = eventTimers[i].deadline;
+    }
+
+    *timeoutMs = (next == -1) ? -1 : (int)(next - now);
+    return fired;
+}
+
+/*
+ * Blocks until something happens. A terminate request is reported before a resize, and both
+ * before input. Output queued for the terminal is written as the terminal takes it, and once
+ * all of it is gone that is reported as a wakeup, since frames were skipped meanwhile.
+ */
+event_e eventWait()
+{
+    struct pollfd pfds[3] =
+    {
+        { .fd = STDIN_FILENO, .events = POLLIN },
+        { .fd = eventPipe[0], .events = POLLIN },
+        { .fd = -1, .events = POLLOUT },
+    };
+
+    while (1)
+    {
+        int timeoutMs;
+        if (eventRunTimers(&timeoutMs)) return EVENT_WAKE;
+
+        // a negative descriptor is left out by poll
+        pfds[2].fd = termOutputFd();
+        int ret = poll(pfds, 3, timeoutMs);
+        if (ret == -1)
+        {
+            if (errno == EINTR) continue;
+            errExit("Failed to poll for events");
+        }
+        if (ret == 0) continue;
+
+        if (pfds[1].revents & POLLIN)
+        {
+            bool resize = false;
+            bool terminate = false;
+            char buf[64];
+            ssize_t n;
+            while ((n = read(eventPipe[0], buf, sizeof(buf))) > 0)
+            {
+                for (ssize_t i = 0; i < n; i++)
+                {
+                    if (buf[i] == SIGWINCH) resize = true;
+                    if (buf[i] == SIGTERM) terminate = true;
+                }
+            }
+
+            if (terminate) return EVENT_TERMINATE;
+            if (resize) return EVENT_RESIZE;
+            return EVENT_WAKE;
+        }
+
+        bool drained = false;
+        if (pfds[2].revents)
+        {
+            termFlush();
+            drained = (termOutputQueued() == 0);
+        }
+
+        // a hangup is reported as input, so the following read fails and ends the editor
+        if (pfds[0].revents) return EVENT_INPUT;
+        if (drained) return EVENT_WAKE;
+    }
+}
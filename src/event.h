@@ -0,0 +1,17 @@
+#pragma once
+
+typedef enum
+{
+    EVENT_INPUT,        // stdin is readable
+    EVENT_RESIZE,       // the window size changed
+    EVENT_TERMINATE,    // SIGTERM was received
+    EVENT_WAKE,         // woken by eventWake or a timer
+} event_e;
+
+typedef void (*eventCallback)(void);
+
+int eventInit();
+void eventWake();
+int eventTimerStart(int delayMs, eventCallback callback);
+void eventTimerStop(int *timer);
+event_e eventWait();
@@ -0,0 +1,418 @@
+#define _DEFAULT_SOURCE
+
+#include "fileview.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#define FILE_VIEW_WINDOW        (1024 * 1024)       // bytes read from the file at once
+#define FILE_VIEW_STRIDE        1024                // lines between two offsets in the index
+#define FILE_VIEW_BLOCKS        4                   // blocks of line offsets kept
+#define FILE_VIEW_ROWS          128                 // rows kept for drawing
+#define FILE_VIEW_MAX_LINE      (16 * 1024)         // longer lines are cut
+#define FILE_VIEW_NOTIFY_BYTES  (64 * 1024 * 1024)  // bytes indexed between notifications
+
+/*
+ * Shows a file without loading it, for files too large to edit. The file is read through a window
+ * of FILE_VIEW_WINDOW bytes, and all that is kept for the whole file is the offset of every
+ * FILE_VIEW_STRIDE-th line, which a worker thread finds in the background. The lines can be shown
+ * as far as the worker got.
+ *
+ * The offsets of the lines in a block of FILE_VIEW_STRIDE lines are found when a line of the block
+ * is needed, by reading on from the indexed offset, and the last few blocks are kept. The rows
+ * handed out for drawing are copies of the lines, in a small cache where each line has one slot.
+ */
+
+typedef struct
+{
+    int block;          // -1 if unused
+    int count;          // lines of the block known so far
+    // start of every line, and the offset after the last one. A last line without a newline
+    // ends one byte past the end of the file, as if it had one.
+    size_t offsets[FILE_VIEW_STRIDE + 1];
+} fileViewBlock_s;
+
+struct fileView_s
+{
+    int fd;
+    size_t size;
+
+    pthread_t thread;
+    atomic_bool quit;
+    void (*notify)(void);       // called from the worker as the index grows
+
+    // written by the worker
+    pthread_mutex_t lock;
+    size_t *index;              // start of line i * FILE_VIEW_STRIDE, protected by lock
+    int indexCount;
+    int indexCapacity;
+    atomic_int numLines;        // lines indexed so far
+    atomic_bool complete;
+
+    // used by the UI thread only
+    char *window;
+    size_t windowStart;
+    size_t windowLen;
+    fileViewBlock_s blocks[FILE_VIEW_BLOCKS];
+    int nextBlock;              // the one replaced next
+    edRow_s rows[FILE_VIEW_ROWS];
+    int rowLines[FILE_VIEW_ROWS];   // line held by each row, -1 if none
+};
+
+
+static void fileViewAddIndex(fileView *view, size_t offset)
+{
+    pthread_mutex_lock(&view->lock);
+    if (view->indexCount == view->indexCapacity)
+    {
+        view->indexCapacity = view->indexCapacity ? view->indexCapacity * 2 : 1024;
+        view->index = realloc(view->index, sizeof(*view->index) * view->indexCapacity);
+        assert(view->index != NULL);
+    }
+    view->index[view->indexCount++] = offset;
+    pthread_mutex_unlock(&view->lock);
+}
+
+static size_t fileViewIndex(fileView *view, int i)
+{
+    pthread_mutex_lock(&view->lock);
+    size_t offset = view->index[i];
+    pthread_mutex_unlock(&view->lock);
+    return offset;
+}
+
+/*
+ * Counts the lines of the file, and records where every FILE_VIEW_STRIDE-th one starts. The line
+ * numbers of the editor are ints, so lines past INT_MAX are never shown.
+ */
+static void *fileViewWorker(void *arg)
+{
+    fileView *view = arg;
+    char *buf = malloc(FILE_VIEW_WINDOW);
+    assert(buf != NULL);
+
+    int lines = 0;
+    size_t offset = 0;
+    size_t notified = 0;
+    char last = '\n';
+    if (view->size > 0) fileViewAddIndex(view, 0);
+
+    while (offset < view->size && lines < INT_MAX - 1 && !atomic_load_explicit(&view->quit, memory_order_relaxed))
+    {
+        ssize_t n = pread(view->fd, buf, FILE_VIEW_WINDOW, offset);
+        if (n <= 0) break;
+
+        const char *p = buf;
+        const char *end = buf + n;
+        const char *nl;
+        while (lines < INT_MAX - 1 && (nl = memchr(p, '\n', end - p)) != NULL)
+        {
+            p = nl + 1;
+            lines++;
+            size_t next = offset + (p - buf);
+            if (lines % FILE_VIEW_STRIDE == 0 && next < view->size) fileViewAddIndex(view, next);
+        }
+
+        offset += n;
+        last = buf[n - 1];
+        // the index entries of these lines were added before they are published
+        atomic_store(&view->numLines, lines);
+        if (offset - notified >= FILE_VIEW_NOTIFY_BYTES && view->notify)
+        {
+            notified = offset;
+            view->notify();
+        }
+    }
+
+    // the file may not end with a newline
+    if (offset == view->size && last != '\n') atomic_store(&view->numLines, lines + 1);
+    atomic_store(&view->complete, true);
+    if (view->notify) view->notify();
+
+    free(buf);
+    return NULL;
+}
+
+/*
+ * Opens a file to be viewed, and starts indexing it. notify, if not NULL, is called from the
+ * worker thread as the index grows. Returns NULL with errno set if the file can't be opened.
+ */
+fileView *fileViewNew(const char *filename, void (*notify)(void))
+{
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return NULL;
+
+    struct stat sb;
+    if (fstat(fd, &sb) == -1)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    fileView *view = calloc(1, sizeof(*view));
+    assert(view != NULL);
+    view->fd = fd;
+    view->size = sb.st_size;
+    view->notify = notify;
+    view->window = malloc(FILE_VIEW_WINDOW);
+    assert(view->window != NULL);
+    for (int i = 0; i < FILE_VIEW_BLOCKS; i++) view->blocks[i].block = -1;
+    for (int i = 0; i < FILE_VIEW_ROWS; i++) view->rowLines[i] = -1;
+    atomic_init(&view->quit, false);
+    atomic_init(&view->numLines, 0);
+    atomic_init(&view->complete, false);
+    pthread_mutex_init(&view->lock, NULL);
+
+    int error = pthread_create(&view->thread, NULL, fileViewWorker, view);
+    if (error != 0)
+    {
+        pthread_mutex_destroy(&view->lock);
+        free(view->window);
+        free(view);
+        close(fd);
+        errno = error;
+        return NULL;
+    }
+
+    return view;
+}
+
+void fileViewFree(fileView **view)
+{
+    if (*view == NULL) return;
+
+    atomic_store(&(*view)->quit, true);
+    pthread_join((*view)->thread, NULL);
+    pthread_mutex_destroy(&(*view)->lock);
+    close((*view)->fd);
+
+    for (int i = 0; i < FILE_VIEW_ROWS; i++)
+    {
+        edRow_s *row = &(*view)->rows[i];
+        free(row->string);
+    }
+    free((*view)->index);
+    free((*view)->window);
+    free(*view);
+    *view = NULL;
+}
+
+/*
+ * Lines indexed so far. Sets complete if that is all of them.
+ */
+int fileViewNumLines(fileView *view, bool *complete)
+{
+    // the count is final once complete is set
+    bool done = atomic_load(&view->complete);
+    if (complete) *complete = done;
+    return atomic_load(&view->numLines);
+}
+
+size_t fileViewSize(fileView *view)
+{
+    return view->size;
+}
+
+/*
+ * Moves the window so it holds the want bytes at offset, or as many as the file has. Returns
+ * the text at offset, and sets avail to the bytes of it in the window.
+ */
+static const char *fileViewRead(fileView *view, size_t offset, size_t want, size_t *avail)
+{
+    if (offset >= view->size)
+    {
+        *avail = 0;
+        return view->window;
+    }
+
+    if (want > view->size - offset) want = view->size - offset;
+    if (offset < view->windowStart || offset + want > view->windowStart + view->windowLen)
+    {
+        // keep some of the text before offset, for scrolling back up
+        size_t start = (offset > FILE_VIEW_WINDOW / 4) ? offset - FILE_VIEW_WINDOW / 4 : 0;
+        ssize_t n = pread(view->fd, view->window, FILE_VIEW_WINDOW, start);
+        view->windowStart = start;
+        view->windowLen = (n > 0) ? n : 0;
+    }
+
+    if (offset >= view->windowStart + view->windowLen)
+    {
+        *avail = 0;
+        return view->window;
+    }
+
+    *avail = view->windowStart + view->windowLen - offset;
+    return &view->window[offset - view->windowStart];
+}
+
+/*
+ * The block with the offsets of an indexed line
+ */
+static fileViewBlock_s *fileViewGetBlock(fileView *view, int line)
+{
+    int block = line / FILE_VIEW_STRIDE;
+    fileViewBlock_s *b = NULL;
+    for (int i = 0; i < FILE_VIEW_BLOCKS; i++)
+    {
+        if (view->blocks[i].block != block) continue;
+        // the last block grows while the file is indexed
+        if (line < block * FILE_VIEW_STRIDE + view->blocks[i].count) return &view->blocks[i];
+        b = &view->blocks[i];
+    }
+
+    if (!b)
+    {
+        b = &view->blocks[view->nextBlock];
+        view->nextBlock = (view->nextBlock + 1) % FILE_VIEW_BLOCKS;
+    }
+
+    int numLines = fileViewNumLines(view, NULL);
+    b->block = block;
+    b->count = numLines - block * FILE_VIEW_STRIDE;
+    if (b->count > FILE_VIEW_STRIDE) b->count = FILE_VIEW_STRIDE;
+
+    size_t pos = fileViewIndex(view, block);
+    for (int i = 0; i < b->count; i++)
+    {
+        b->offsets[i] = pos;
+        while (1)
+        {
+            size_t avail;
+            const char *p = fileViewRead(view, pos, 1, &avail);
+            if (avail == 0)
+            {
+                pos = view->size + 1;
+                break;
+            }
+
+            const char *nl = memchr(p, '\n', avail);
+            if (nl)
+            {
+                pos += nl - p + 1;
+                break;
+            }
+            pos += avail;
+        }
+    }
+    b->offsets[b->count] = pos;
+
+    return b;
+}
+
+/*
+ * Text of an indexed line, without the line ending and cut at FILE_VIEW_MAX_LINE. It stays valid
+ * until the window moves.
+ */
+static const char *fileViewLineText(fileView *view, int line, int *len)
+{
+    fileViewBlock_s *b = fileViewGetBlock(view, line);
+    int i = line % FILE_VIEW_STRIDE;
+    size_t start = b->offsets[i];
+    size_t size = b->offsets[i + 1] - 1 - start;
+    bool cut = (size > FILE_VIEW_MAX_LINE);
+    if (cut) size = FILE_VIEW_MAX_LINE;
+
+    size_t avail;
+    const char *text = fileViewRead(view, start, size, &avail);
+    if (avail < size) size = avail;
+    while (!cut && size > 0 && text[size - 1] == '\r') size--;
+
+    *len = size;
+    return text;
+}
+
+/*
+ * Offset in the file of an indexed line
+ */
+size_t fileViewLineOffset(fileView *view, int line)
+{
+    if (line < 0 || line >= fileViewNumLines(view, NULL)) return view->size;
+    return fileViewGetBlock(view, line)->offsets[line % FILE_VIEW_STRIDE];
+}
+
+/*
+ * The line that holds the byte at offset, or the last indexed line if it is not indexed yet
+ */
+int fileViewLineAt(fileView *view, size_t offset)
+{
+    int numLines = fileViewNumLines(view, NULL);
+    if (numLines == 0) return 0;
+
+    // the last block that starts at or before offset
+    int lo = 0;
+    int hi = (numLines - 1) / FILE_VIEW_STRIDE;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (fileViewIndex(view, mid) <= offset) lo = mid;
+        else hi = mid - 1;
+    }
+
+    fileViewBlock_s *b = fileViewGetBlock(view, lo * FILE_VIEW_STRIDE);
+    int i = 0;
+    while (i + 1 < b->count && b->offsets[i + 1] <= offset) i++;
+
+    return lo * FILE_VIEW_STRIDE + i;
+}
+
+/*
+ * A row with the text of an indexed line. It stays valid until the row of another line takes
+ * its slot, so the rows of FILE_VIEW_ROWS lines in a row can be used at the same time.
+ */
+edRow_s *fileViewGetRow(fileView *view, int line)
+{
+    int slot = line % FILE_VIEW_ROWS;
+    edRow_s *row = &view->rows[slot];
+    if (view->rowLines[slot] == line) return row;
+
+    int len;
+    const char *text = fileViewLineText(view, line, &len);
+    if (len + 1 > row->capacity)
+    {
+        row->capacity = len + 1;
+        row->string = realloc(row->string, row->capacity);
+        assert(row->string != NULL);
+    }
+    memcpy(row->string, text, len);
+    row->string[len] = '\0';
+    row->size = len;
+
+    // rendered again when it is drawn
+    row->renderStamp = 0;
+
+    view->rowLines[slot] = line;
+    return row;
+}
+
+/*
+ * Finds the first match at or after (fromLine, fromCol) in the lines indexed so far
+ */
+bool fileViewFind(fileView *view, search *s, int fromLine, int fromCol, searchMatch_s *match)
+{
+    int numLines = fileViewNumLines(view, NULL);
+    int col = fromCol;
+
+    for (int line = (fromLine < 0) ? 0 : fromLine; line < numLines; line++)
+    {
+        int len, start, end;
+        const char *text = fileViewLineText(view, line, &len);
+        if (searchLine(s, text, len, col, &start, &end))
+        {
+            match->row = line;
+            match->col = start;
+            match->len = end - start;
+            return true;
+        }
+        col = 0;
+    }
+
+    return false;
+}
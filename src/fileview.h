@@ -0,0 +1,18 @@
+#pragma once
+
+#include "document.h"
+#include "search.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct fileView_s fileView;
+
+fileView *fileViewNew(const char *filename, void (*notify)(void));
+void fileViewFree(fileView **view);
+int fileViewNumLines(fileView *view, bool *complete);
+size_t fileViewSize(fileView *view);
+size_t fileViewLineOffset(fileView *view, int line);
+int fileViewLineAt(fileView *view, size_t offset);
+edRow_s *fileViewGetRow(fileView *view, int line);
+bool fileViewFind(fileView *view, search *s, int fromLine, int fromCol, searchMatch_s *match);
@@ -6,21 +6,38 @@
 #include "terminal.h"
 #include "astring.h"
 #include "syntax.h"
+#include "document.h"
+#include "screen.h"
+#include "search.h"
+#include "searchindex.h"
+#include "savejob.h"
+#include "undo.h"
+#include "replay.h"
+#include "event.h"
+#include "render.h"
+#include "fileview.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <errno.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
 #include <assert.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/stat.h>
 
 #define NED_VERSION "0.1"
 
-#define NED_TAB_STOP 8
 #define NED_QUIT_TIMES 2
+#define NED_UNDO_LIMIT (64 * 1024 * 1024)  // bytes of undo history kept
+#define NED_IDLE_MS 100    // refresh interval while something runs in the background
+#define NED_STATUS_MSG_SECS 5
 
 //#define ESC_KEY '\x1b'
 #define CTRL_KEY(k) ((k) & 0x1f)
@@ -28,14 +45,6 @@
 
 static bool nedRunning = true;
 
-typedef struct
-{
-    char *string;
-    int size;
-    char *renderString;
-    int renderSize;
-} edRow_s;
-
 struct edCursorPos_s
 {
     int cx;
@@ -44,6 +53,22 @@ struct edCursorPos_s
     int colOffset;
 };
 
+/*
+ * An open file. Only the current buffer is shown, the others keep their cursor position.
+ */
+typedef struct
+{
+    document *doc;
+    char *filename;
+    bool dirty;
+    unsigned long changes;      // bumped on every edit
+    undo *undo;
+    saveJob *saveJob;           // only while saving
+    unsigned long saveChanges;  // value of changes when the save started
+    struct edCursorPos_s cursor;    // where the cursor was when another buffer was shown
+    fileView *view;             // a file shown read-only, without loading it. doc stays empty
+} edBuffer_s;
+
 typedef struct
 {
     int winRows;    // window size
@@ -51,15 +76,21 @@ typedef struct
     int cx;         // cursor pos
     int cy;
     int rx;         // render pos
-    edRow_s *row;
-    int numRows;
     int rowOffset;
     int colOffset;
-    char *filename;
     char statusMsg[80];
     time_t statusMsgTime;
-    bool dirty;
+    int statusTimer;            // clears the status message when it expires
     struct edCursorPos_s prevCursorPos;
+    screen *screen;
+    astring *frame;     // reused for every refresh
+    edBuffer_s *drawnBuf;       // the buffer and rowOffset of the last frame, to scroll from
+    int drawnRowOffset;
+    searchIndex *searchIndex;   // only during incremental search
+    int saveTimer;              // refreshes the progress while any buffer is saving
+    edBuffer_s **buffers;       // in the order they were opened
+    int numBuffers;
+    edBuffer_s *buf;            // the buffer shown
 } edConfig_s;
 
 
@@ -69,41 +100,144 @@ typedef void (*promptCallback)(char *, int);
 void edInsertChar(int c);
 void edDeleteChar();
 void edNewLine();
+void edMoveRows(int n);
+void edPaste();
 void edSaveFile(const char *filename);
+void edUpdateSave();
+void edResize();
 void edSetStatusMessage(const char *fmt, ...);
-void edRowDeleteChar(edRow_s *row, int at);
+void edUpdateRow(edRow_s *row, int at, int removed, int inserted);
 void edFind(void);
 void edIncrementalFind(void);
+void edUndo(void);
+void edRedo(void);
+void edGotoPos(int row, int col);
+void edGoto(void);
+void edOpenPrompt(void);
+void edSwitchBuffer(int step);
+edBuffer_s *edUnsavedBuffer();
 
 
 static edConfig_s edConfig;
 
+static inline int edNumRows()
+{
+    if (edConfig.buf->view) return fileViewNumLines(edConfig.buf->view, NULL);
+    return docNumRows(edConfig.buf->doc);
+}
+
+static inline edRow_s *edGetRow(int at)
+{
+    if (edConfig.buf->view) return fileViewGetRow(edConfig.buf->view, at);
+    return docGetRow(edConfig.buf->doc, at);
+}
+
+static inline size_t edRowOffset(int at)
+{
+    if (edConfig.buf->view) return fileViewLineOffset(edConfig.buf->view, at);
+    return docRowOffset(edConfig.buf->doc, at);
+}
+
+static inline int edRowAtOffset(size_t offset)
+{
+    if (edConfig.buf->view) return fileViewLineAt(edConfig.buf->view, offset);
+    return docRowAtOffset(edConfig.buf->doc, offset);
+}
+
+static inline size_t edSize()
+{
+    if (edConfig.buf->view) return fileViewSize(edConfig.buf->view);
+    return docSize(edConfig.buf->doc);
+}
+
+/*
+ * Size of the row under the cursor. The cursor can be one line past the last row, which is empty
+ */
+static inline int edCursorRowSize()
+{
+    if (edConfig.cy >= edNumRows()) return 0;
+    return edGetRow(edConfig.cy)->size;
+}
+
+static inline const char *edBufferName(edBuffer_s *b)
+{
+    return (b->filename == NULL) ? "No Name" : b->filename;
+}
+
+/*
+ * Tells the user when the buffer can't be edited. Returns true if so.
+ */
+static bool edReadOnly()
+{
+    if (!edConfig.buf->view) return false;
+    edSetStatusMessage("%.20s is open read-only", edBufferName(edConfig.buf));
+    return true;
+}
+
+static int edBufferIndex(edBuffer_s *b)
+{
+    for (int i = 0; i < edConfig.numBuffers; i++)
+    {
+        if (edConfig.buffers[i] == b) return i;
+    }
+
+    return -1;
+}
+
+/*
+ * Marks the document as modified. The edit count tells a background save if the document
+ * was changed after its snapshot was taken.
+ */
+static inline void edSetDirty()
+{
+    edConfig.buf->dirty = true;
+    edConfig.buf->changes++;
+}
+
 static FILE *logFile = NULL;
 #define LOG(format, ...) { fprintf(logFile, format, __VA_ARGS__); fflush(logFile); }
 
+/*
+ * Moves the cursor n rows down, or up if n is negative, and keeps it in the same screen column
+ */
+void edMoveRows(int n)
+{
+    int next = edConfig.cy + n;
+    if (next > edNumRows() - 1) next = edNumRows() - 1;
+    if (next < 0) next = 0;
+
+    // the same column can be at another index, after tabs or wide characters
+    if (next != edConfig.cy && edConfig.cy < edNumRows())
+    {
+        int rx = renderCxToRx(edGetRow(edConfig.cy), edConfig.cx);
+        edConfig.cx = renderRxToCx(edGetRow(next), rx);
+    }
+    edConfig.cy = next;
+    if (edConfig.cx > edCursorRowSize()) edConfig.cx = edCursorRowSize();
+}
+
 void edMoveCursor(int key)
 {
     switch(key)
     {
         case ARROW_UP:
-            if (edConfig.cy > 0) edConfig.cy--;
+            edMoveRows(-1);
             break;
         case ARROW_DOWN:
-            if (edConfig.cy < edConfig.numRows - 1) edConfig.cy++;
+            edMoveRows(1);
             break;
         case ARROW_RIGHT:
-            // get the size of the column at the current row (cy)
-            //if (edConfig.cx < edConfig.row[edConfig.cy].renderSize - 1) edConfig.cx++;
-            edConfig.cx++;
+            // a whole UTF-8 character at a time
+            if (edConfig.cy < edNumRows()) edConfig.cx = renderNextCx(edGetRow(edConfig.cy), edConfig.cx);
             break;
         case ARROW_LEFT:
-            if (edConfig.cx > 0) edConfig.cx--;
+            if (edConfig.cy < edNumRows()) edConfig.cx = renderPrevCx(edGetRow(edConfig.cy), edConfig.cx);
             break;
         case HOME:
             edConfig.cx = 0;
             break;
         case END:
-            edConfig.cx = edConfig.row[edConfig.cy].size;
+            edConfig.cx = edCursorRowSize();
             break;
         default:
             assert(false);
@@ -111,18 +245,63 @@ void edMoveCursor(int key)
     }
 
     // if cursor ends up past the line end, snap it to end of line
-    if (edConfig.cx >= edConfig.row[edConfig.cy].size) edConfig.cx = edConfig.row[edConfig.cy].size;
+    if (edConfig.cx >= edCursorRowSize()) edConfig.cx = edCursorRowSize();
     // limit cx to 0 in case of empty line
     if (edConfig.cx < 0) edConfig.cx = 0;
 }
 
+/*
+ * Moves the cursor to (row, col), clamped to the text
+ */
+void edGotoPos(int row, int col)
+{
+    if (row > edNumRows() - 1) row = edNumRows() - 1;
+    if (row < 0) row = 0;
+    edConfig.cy = row;
+
+    if (col > edCursorRowSize()) col = edCursorRowSize();
+    if (col < 0) col = 0;
+    // not in the middle of a UTF-8 character
+    if (row < edNumRows()) col = renderRxToCx(edGetRow(row), renderCxToRx(edGetRow(row), col));
+    edConfig.cx = col;
+}
+
+/*
+ * Waits for the next key. Returns IDLE_KEY when the screen needs a refresh for some other reason,
+ * like a resize, a timer or a background task.
+ */
+int edReadKey()
+{
+    // a script never waits, and neither do keys that were read along with earlier ones
+    if (termIsHeadless() || termInputPending()) return termReadKey();
+
+    switch (eventWait())
+    {
+        case EVENT_INPUT:
+            return termReadKey();
+        case EVENT_RESIZE:
+            edResize();
+            return IDLE_KEY;
+        case EVENT_TERMINATE:
+            // also cancels a prompt
+            nedRunning = false;
+            return ESC_KEY;
+        case EVENT_WAKE:
+            break;
+    }
+
+    return IDLE_KEY;
+}
+
 void edProcessKey()
 {
     static int quitTimes = NED_QUIT_TIMES;
-    int key = termReadKey();
+    int key = edReadKey();
 
     switch (key)
     {
+        case IDLE_KEY:
+            break;
         case ESC_KEY:
         case CTRL_KEY('l'):     // screen refresh not needed since we do it on every update
             // TODO
@@ -130,9 +309,10 @@ void edProcessKey()
         case CTRL_KEY('h'):
         case BACKSPACE:
         case DELETE:
+            if (edReadOnly()) break;
             if (key == DELETE)
             {
-                if (edConfig.cx == edConfig.row[edConfig.cy].size)
+                if (edConfig.cx == edCursorRowSize())
                 {
                     edMoveCursor(ARROW_DOWN);
                     edMoveCursor(HOME);
@@ -156,18 +336,20 @@ void edProcessKey()
         case HOME:
         case END:
             edMoveCursor(key);
+            undoBreak(edConfig.buf->undo);
             break;
         case PAGE_UP:
         case PAGE_DOWN:
             {
-                int times = edConfig.winRows - 1;
-                while (times--) edMoveCursor(key == PAGE_UP ? ARROW_UP : ARROW_DOWN);
+                undoBreak(edConfig.buf->undo);
+                int page = edConfig.winRows - 1;
+                edMoveRows(key == PAGE_UP ? -page : page);
             }
             break;
         case CTRL_KEY('q'):
-            if (edConfig.dirty)
+            if (edUnsavedBuffer())
             {
-                edSetStatusMessage("File modified, press CTRL-Q again to discard changes and quit");
+                edSetStatusMessage("%.20s modified, press CTRL-Q again to discard changes and quit", edBufferName(edUnsavedBuffer()));
                 quitTimes--;
                 if (quitTimes == 0) nedRunning = false;
             }
@@ -176,21 +358,44 @@ void edProcessKey()
                 nedRunning = false;
             }
 
-            write(STDOUT_FILENO, "\x1b[2J", 4);
-            write(STDOUT_FILENO, "\x1b[H", 3);
+            termWrite(DISPLAY_ERASE_ALL_CMD, DISPLAY_ERASE_ALL_LEN);
+            termWrite(CURSOR_ORIGIN_CMD, CURSOR_ORIGIN_LEN);
+            screenInvalidate(edConfig.screen);
             // we need to return here, to not reset the quitTime counter at the end
             return;
         case CTRL_KEY('w'):
-            edSaveFile(edConfig.filename);
+            edSaveFile(edConfig.buf->filename);
             //edSetStatusMessage("File saved successfully!");
             break;
         case CTRL_KEY('f'):
             edFind();
+            undoBreak(edConfig.buf->undo);
             break;
         case CTRL_KEY('g'):
             edIncrementalFind();
+            undoBreak(edConfig.buf->undo);
+            break;
+        case CTRL_KEY('t'):
+            edGoto();
+            undoBreak(edConfig.buf->undo);
+            break;
+        case CTRL_KEY('z'):
+            edUndo();
+            break;
+        case CTRL_KEY('y'):
+            edRedo();
+            break;
+        case CTRL_KEY('o'):
+            edOpenPrompt();
             break;
         case CTRL_KEY('n'):
+            edSwitchBuffer(1);
+            break;
+        case CTRL_KEY('p'):
+            edSwitchBuffer(-1);
+            break;
+        case PASTE_START:
+            edPaste();
             break;
         default:
             edInsertChar(key);
@@ -202,7 +407,7 @@ void edProcessKey()
 
 void edDrawWelcomeMsg(astring *frame)
 {
-    if (edConfig.numRows == 0)
+    if (edNumRows() == 0)
     {
 
         char welcome[128] = { 0 };
@@ -225,19 +430,41 @@ void edDrawWelcomeMsg(astring *frame)
     }
 }
 
-void edDrawStatusBar(astring *frame)
+void edDrawStatusBar(screen *scr)
 {
+    astring *frame = screenLine(scr, edConfig.winRows);
     // TODO(noxet): make macros for colors
     astringAppend(frame, "\x1b[7m", 4);
     char status[256];
-    char *filename = (edConfig.filename == NULL) ? "No Name" : edConfig.filename;
-    char *dirty = (edConfig.dirty) ? "(modified)" : "";
-    int statusLen = snprintf(status, sizeof(status), "[%.20s] - %d lines %s", filename, edConfig.numRows, dirty);
+    const char *dirty = (edConfig.buf->dirty) ? "(modified)" : "";
+    // a viewed file is still being counted until it is complete
+    bool counted = true;
+    if (edConfig.buf->view)
+    {
+        fileViewNumLines(edConfig.buf->view, &counted);
+        dirty = "(read-only)";
+    }
+    int statusLen = snprintf(status, sizeof(status), "[%.20s] - %d%s lines %s", edBufferName(edConfig.buf), edNumRows(), counted ? "" : "+", dirty);
+    if (edConfig.numBuffers > 1)
+    {
+        int index = edBufferIndex(edConfig.buf);
+        statusLen += snprintf(&status[statusLen], sizeof(status) - statusLen, " (buffer %d of %d)", index + 1, edConfig.numBuffers);
+    }
     astringAppend(frame, status, statusLen);
 
     // right-adjusted status bar
-    char rstatus[32];
-    int rstatusLen = snprintf(rstatus, sizeof(rstatus), "[%d / %d]", edConfig.cy + 1, edConfig.numRows);
+    char rstatus[64];
+    int rstatusLen = 0;
+    if (edConfig.searchIndex)
+    {
+        // the match count fills in while the search runs in the background
+        int pos = 0;
+        bool complete = false;
+        int count = searchIndexStatus(edConfig.searchIndex, edConfig.cy, edConfig.cx, &pos, &complete);
+        if (pos) rstatusLen = snprintf(rstatus, sizeof(rstatus), "[match %d of %d%s] ", pos, count, complete ? "" : "+");
+        else rstatusLen = snprintf(rstatus, sizeof(rstatus), "[%d%s matches] ", count, complete ? "" : "+");
+    }
+    rstatusLen += snprintf(&rstatus[rstatusLen], sizeof(rstatus) - rstatusLen, "[%d / %d]", edConfig.cy + 1, edNumRows());
     // fill the rest of the status bar with white color
     while (statusLen < edConfig.winCols - rstatusLen)
     {
@@ -248,42 +475,28 @@ void edDrawStatusBar(astring *frame)
     astringAppend(frame, rstatus, rstatusLen);
 
     astringAppend(frame, "\x1b[m", 3);
-    astringAppend(frame, "\r\n", 2);
 }
 
 
-void edDrawMessageBar(astring *frame)
+void edDrawMessageBar(screen *scr)
 {
-    // clear the line
-    astringAppend(frame, "\x1b[K", 3);
+    astring *frame = screenLine(scr, edConfig.winRows + 1);
     size_t msgLen = strlen(edConfig.statusMsg);
-    if (msgLen && (time(NULL) - edConfig.statusMsgTime < 5))
+    if (msgLen > (size_t)edConfig.winCols) msgLen = edConfig.winCols;
+    if (msgLen && (time(NULL) - edConfig.statusMsgTime < NED_STATUS_MSG_SECS))
     {
         astringAppend(frame, edConfig.statusMsg, msgLen);
     }
 }
 
 
-static inline int edRowCxToRx(edRow_s *row, int cx)
-{
-    int rx = 0;
-    for (int i = 0; i < cx; i++)
-    {
-        if (row->string[i] == '\t') rx += (NED_TAB_STOP - 1) - (rx % NED_TAB_STOP);
-        rx++;
-    }
-
-    return rx;
-}
-
-
 void edScroll()
 {
     edConfig.rx = 0;
 
-    if (edConfig.cy < edConfig.numRows)
+    if (edConfig.cy < edNumRows())
     {
-        edConfig.rx = edRowCxToRx(&edConfig.row[edConfig.cy], edConfig.cx);
+        edConfig.rx = renderCxToRx(edGetRow(edConfig.cy), edConfig.cx);
     }
 
     if (edConfig.cy >= edConfig.winRows)
@@ -310,61 +523,16 @@ void edScroll()
     }
 }
 
-void edDrawRows(astring *frame)
+void edDrawRows(screen *scr)
 {
     for (int y = 0; y < edConfig.winRows; y++)
     {
+        astring *frame = screenLine(scr, y);
         int off = edConfig.rowOffset;
-        if (y < (edConfig.numRows - off))
+        if (y < (edNumRows() - off))
         {
-            // limit text size to the window width
-            edRow_s currRow = edConfig.row[y + off];
-            // do not scroll further than row size. Print at most the NULL char
-            int colOffset = (edConfig.colOffset <= currRow.renderSize) ? edConfig.colOffset : currRow.renderSize;
-            int len = (currRow.renderSize - colOffset > edConfig.winCols) ? edConfig.winCols : currRow.renderSize - colOffset;
-            //astringAppend(frame, &currRow.renderString[colOffset], len);
-            char *line = strdup(&currRow.renderString[colOffset]);
-            // TODO(noxet): We need to go through the original string, and check if we are at a token.
-            // If so, then we add append the token along with color, and move on to the rest of the 
-            // characters. Right now, we just check every word, removing whitespace which fucks up
-            // the strings..
-            char *token = strtok(line, " ");
-            while (token)
-            {
-                termColor_e color = synGetKeyword(token);
-                if (color != TERM_COLOR_NONE)
-                {
-                    char *colorStr = termGetColor(color);
-                    astringAppend(frame, colorStr, strlen(colorStr));
-                    astringAppend(frame, token, strlen(token));
-                    astringAppend(frame, FG_COLOR_RESET, FG_COLOR_RESET_SIZE);
-                }
-                else
-                {
-                    astringAppend(frame, token, strlen(token));
-                }
-
-                astringAppend(frame, " ", 1);
-
-                token = strtok(NULL, " ");
-            }
-            /*
-            for (int i = 0; i < len; i++)
-            {
-                if (isdigit(line[i]))
-                {
-                    astringAppend(frame, FG_COLOR_RED, 5);
-                    astringAppend(frame, &line[i], 1);
-                    astringAppend(frame, FG_COLOR_RESET, 4);
-                }
-                else
-            {
-                    astringAppend(frame, &line[i], 1);
-                }
-            }
-            */
-
-            free(line);
+            // limit text size to the window width, rows are rendered the first time they are shown
+            renderDraw(edGetRow(y + off), edConfig.colOffset, edConfig.winCols, frame);
         }
         else if (y == edConfig.winRows / 3)
         {
@@ -374,11 +542,6 @@ void edDrawRows(astring *frame)
         {
             astringAppend(frame, "~", 1);
         }
-
-        // Erase line by line as we print new text
-        astringAppend(frame, DISPLAY_ERASE_LINE_CMD, DISPLAY_ERASE_LINE_LEN);
-        //if (y < edConfig.winRows - 1)
-        astringAppend(frame, "\r\n", 2);
     }
 }
 
@@ -386,14 +549,30 @@ void edRefreshScreen()
 {
     edScroll();
 
-    astring *frame = astringNew();
+    // while the terminal has not taken all of the last frame, drawing more only makes it fall
+    // further behind. The screen keeps what was drawn last, so the frame drawn once the output
+    // is gone, when eventWait wakes us up, has all changes since.
+    if (termOutputQueued() > 0) return;
 
-    astringAppend(frame, CURSOR_HIDE_CMD, CURSOR_HIDE_LEN);
-    astringAppend(frame, CURSOR_ORIGIN_CMD, CURSOR_ORIGIN_LEN);
+    // the rows still on screen are moved by the terminal, instead of being sent again
+    if (edConfig.buf == edConfig.drawnBuf) screenScroll(edConfig.screen, 0, edConfig.winRows, edConfig.rowOffset - edConfig.drawnRowOffset);
+    edConfig.drawnBuf = edConfig.buf;
+    edConfig.drawnRowOffset = edConfig.rowOffset;
+
+    astring *frame = edConfig.frame;
+    astringClear(frame);
 
-    edDrawRows(frame);
-    edDrawStatusBar(frame);
-    edDrawMessageBar(frame);
+    edDrawRows(edConfig.screen);
+    edDrawStatusBar(edConfig.screen);
+    edDrawMessageBar(edConfig.screen);
+
+    // only the lines that differ from what is on screen are sent to the terminal, as one update
+    // if the terminal supports it, so it never shows a frame that is drawn in part
+    bool sync = termHasSyncUpdate();
+    if (sync) astringAppend(frame, SYNC_BEGIN_CMD, SYNC_BEGIN_LEN);
+    astringAppend(frame, CURSOR_HIDE_CMD, CURSOR_HIDE_LEN);
+    bool changed = screenRender(edConfig.screen, frame) > 0;
+    if (!changed) astringClear(frame);
 
     // Set cursor position
     char cursorPos[32];
@@ -401,11 +580,16 @@ void edRefreshScreen()
     int cursorPosLen = snprintf(cursorPos, sizeof(cursorPos), "\x1b[%d;%dH", edConfig.cy  - edConfig.rowOffset + 1, edConfig.rx  - edConfig.colOffset + 1);
     astringAppend(frame, cursorPos, cursorPosLen);
 
-    astringAppend(frame, CURSOR_SHOW_CMD, CURSOR_SHOW_LEN);
+    if (changed) astringAppend(frame, CURSOR_SHOW_CMD, CURSOR_SHOW_LEN);
+    if (changed && sync) astringAppend(frame, SYNC_END_CMD, SYNC_END_LEN);
 
-    write(STDOUT_FILENO, astringGetString(frame), astringGetLen(frame));
+    termWrite(astringGetString(frame), astringGetLen(frame));
+}
 
-    astringFree(&frame);
+static void edStatusTimer()
+{
+    // the refresh that follows leaves out the expired message
+    edConfig.statusTimer = -1;
 }
 
 void edSetStatusMessage(const char *fmt, ...)
@@ -415,6 +599,9 @@ void edSetStatusMessage(const char *fmt, ...)
     vsnprintf(edConfig.statusMsg, sizeof(edConfig.statusMsg), fmt, ap);
     va_end(ap);
     edConfig.statusMsgTime = time(NULL);
+
+    eventTimerStop(&edConfig.statusTimer);
+    edConfig.statusTimer = eventTimerStart(NED_STATUS_MSG_SECS * 1000, edStatusTimer);
 }
 
 
@@ -422,94 +609,80 @@ void edSetStatusMessage(const char *fmt, ...)
  * Row operations
  */
 
-void edRenderRow(edRow_s *row)
+/*
+ * Called after string[at, at + removed) of a row was replaced by inserted characters
+ */
+void edUpdateRow(edRow_s *row, int at, int removed, int inserted)
 {
-    // free previously allocated mem
-    free(row->renderString);
-    row->renderSize = 0;
-    size_t numTabs = 0;
-    size_t numKeywords = 0;
-    for (int i = 0; i < row->size; i++)
-    {
-        if (row->string[i] == '\t') numTabs++;
-    }
-
-    row->renderString = malloc(row->size + (numTabs * (NED_TAB_STOP - 1)) + 1);
-
-    int idx = 0;
-    while (row->string[idx])
-    {
-        switch (row->string[idx])
-        {
-            case '\t':
-                {
-                    row->renderString[row->renderSize++] = ' ';
-                    while (row->renderSize % NED_TAB_STOP != 0) row->renderString[row->renderSize++] = ' ';
-                }
-                break;
-            default:
-                // just copy the chars as normal
-                row->renderString[row->renderSize] = row->string[idx];
-                row->renderSize++;
-                break;
-        }
-        idx++;
-    }
-
-    row->renderString[row->renderSize] = '\0';
+    docRowChanged(edConfig.buf->doc, row);
+    renderRowEdit(row, at, removed, inserted);
 }
 
-void edInsertRow(int at, char *line, size_t lineLen)
+void edInsertRow(int at, const char *line, size_t lineLen)
 {
-    // TODO(noxet): reallocate row when we hit limit
-    memmove(&edConfig.row[at + 1], &edConfig.row[at], sizeof(edRow_s) * (edConfig.numRows - at));
+    edRow_s *row = docInsertRow(edConfig.buf->doc, at);
 
-    edConfig.row[at].size = lineLen;
-    // TODO(noxet): free this memory later, in edClose?
-    edConfig.row[at].string = malloc(lineLen + 1);
-    memcpy(edConfig.row[at].string, line, lineLen);
-    edConfig.row[at].string[lineLen] = '\0';
+    docRowReserve(edConfig.buf->doc, row, lineLen);
+    memcpy(row->string, line, lineLen);
+    row->string[lineLen] = '\0';
+    row->size = lineLen;
 
-    edConfig.row[at].renderString = NULL;
-    edConfig.row[at].renderSize = 0;
+    // the row is rendered once it is drawn
+    docRowChanged(edConfig.buf->doc, row);
 
-    edRenderRow(&edConfig.row[at]);
-
-    edConfig.numRows++;
-
-    edConfig.dirty = true;
+    edSetDirty();
 }
 
 void edRowInsertChar(edRow_s *row, int at, int c)
 {
     if (at < 0 || at > row->size) at = row->size;
-    row->string = realloc(row->string, row->size + 2); // +2 for new char and NULL-byte at the end
+    docRowReserve(edConfig.buf->doc, row, row->size + 1);
     memmove(&row->string[at + 1], &row->string[at], row->size - at + 1);
     row->size++;
     row->string[at] = c;
     row->string[row->size] = '\0';
-    edRenderRow(row);
+    edUpdateRow(row, at, 0, 1);
+}
+
+void edRowInsertString(edRow_s *row, int at, const char *str, int strLen)
+{
+    docRowReserve(edConfig.buf->doc, row, row->size + strLen);
+    memmove(&row->string[at + strLen], &row->string[at], row->size - at);
+    memcpy(&row->string[at], str, strLen);
+    row->size += strLen;
+    row->string[row->size] = '\0';
+
+    edUpdateRow(row, at, 0, strLen);
+    edSetDirty();
 }
 
-void edRowDeleteChar(edRow_s *row, int at)
+void edRowDeleteString(edRow_s *row, int at, int len)
 {
-    if (at < 0) return;
-    memmove(&row->string[at], &row->string[at + 1], row->size - at);
-    row->size--;
-    //row->string = realloc(row->string, row->size - 1);
-    edRenderRow(row);
+    docRowReserve(edConfig.buf->doc, row, row->size);
+    memmove(&row->string[at], &row->string[at + len], row->size - at - len);
+    row->size -= len;
+    row->string[row->size] = '\0';
+
+    edUpdateRow(row, at, len, 0);
+    edSetDirty();
 }
 
-void edRowAppendString(edRow_s *row, char *str)
+void edRowAppendString(edRow_s *row, const char *str, int strLen)
 {
-    size_t strLen = strlen(str);
+    edRowInsertString(row, row->size, str, strLen);
+}
 
-    row->string = realloc(row->string, row->size + strLen + 1);
-    strcat(row->string, str);
-    row->size += strLen;
+/*
+ * Cuts the row off at size
+ */
+void edRowTruncate(edRow_s *row, int size)
+{
+    int removed = row->size - size;
+    docRowReserve(edConfig.buf->doc, row, size);
+    row->size = size;
+    row->string[size] = '\0';
 
-    edRenderRow(row);
-    edConfig.dirty = true;
+    edUpdateRow(row, size, removed, 0);
 }
 
 /*
@@ -517,219 +690,416 @@ void edRowAppendString(edRow_s *row, char *str)
  */
 void edInsertChar(int c)
 {
-    if (edConfig.cy == edConfig.numRows)
+    if (edReadOnly()) return;
+
+    if (edConfig.cy == edNumRows())
     {
-        edInsertRow(edConfig.numRows, "", 0);
+        undoRecord(edConfig.buf->undo, UNDO_ADD_ROW, edNumRows(), 0, "", 0);
+        edInsertRow(edNumRows(), "", 0);
     }
 
-    edRowInsertChar(&edConfig.row[edConfig.cy], edConfig.cx, c);
+    char ch = c;
+    undoRecord(edConfig.buf->undo, UNDO_INSERT, edConfig.cy, edConfig.cx, &ch, 1);
+    edRowInsertChar(edGetRow(edConfig.cy), edConfig.cx, c);
     edConfig.cx++;
 
-    edConfig.dirty = true;
-}
-
-void edFreeRow(edRow_s *row)
-{
-    free(row->string);
-    free(row->renderString);
+    edSetDirty();
 }
 
 void edDeleteRow(int atY)
 {
-    if (atY <= 0 || atY > edConfig.numRows) return;
-    edRowAppendString(&edConfig.row[atY - 1], edConfig.row[atY].string);
-    edFreeRow(&edConfig.row[atY]);
-    memmove(&edConfig.row[atY], &edConfig.row[atY + 1], sizeof(edRow_s) * (edConfig.numRows - atY - 1));
-    edConfig.numRows--;
-    edConfig.dirty = true;
+    if (atY <= 0 || atY >= edNumRows()) return;
+    edRow_s *row = edGetRow(atY);
+    edRowAppendString(edGetRow(atY - 1), row->string, row->size);
+    docDeleteRow(edConfig.buf->doc, atY);
+    edSetDirty();
 }
 
 void edDeleteChar()
 {
-    if (edConfig.cy == edConfig.numRows) return;
+    if (edConfig.cy == edNumRows()) return;
     if (edConfig.cx == 0 && edConfig.cy == 0) return;
 
     if (edConfig.cx <= 0)
     {
-        edConfig.cx = edConfig.row[edConfig.cy - 1].size;
+        edConfig.cx = edGetRow(edConfig.cy - 1)->size;
+        undoRecord(edConfig.buf->undo, UNDO_DELETE, edConfig.cy - 1, edConfig.cx, "\n", 1);
         edDeleteRow(edConfig.cy);
         edConfig.cy--;
     }
     else
     {
-        edRow_s *row = &edConfig.row[edConfig.cy];
-        edRowDeleteChar(row, edConfig.cx - 1);
-        edConfig.cx--;
+        // the whole UTF-8 character, with the combining marks that follow it
+        edRow_s *row = edGetRow(edConfig.cy);
+        int at = renderPrevCx(row, edConfig.cx);
+        undoRecord(edConfig.buf->undo, UNDO_DELETE, edConfig.cy, at, &row->string[at], edConfig.cx - at);
+        edRowDeleteString(row, at, edConfig.cx - at);
+        edConfig.cx = at;
     }
 
-    edConfig.dirty = true;
+    edSetDirty();
 }
 
 void edNewLine()
 {
-    edRow_s *row = &edConfig.row[edConfig.cy];
+    if (edReadOnly()) return;
+
+    if (edConfig.cy == edNumRows())
+    {
+        undoRecord(edConfig.buf->undo, UNDO_ADD_ROW, edNumRows(), 0, "", 0);
+        edInsertRow(edNumRows(), "", 0);
+    }
+
+    undoRecord(edConfig.buf->undo, UNDO_INSERT, edConfig.cy, edConfig.cx, "\n", 1);
+    edRow_s *row = edGetRow(edConfig.cy);
 
     char *s = &row->string[edConfig.cx];
     int sSize = row->size - edConfig.cx;
-    // insert row will strdup the string so we have a real copy of it
-    edInsertRow(edConfig.cy + 1, s, sSize);
+    // insert row will make a real copy of the string. Do it last, since it invalidates row
+    char *tail = strndup(s, sSize);
 
     // TODO(noxet): cleanup unused mem?
-    row->string[edConfig.cx] = '\0';
-    row->size -= sSize;
-    edRenderRow(row);
+    edRowTruncate(row, edConfig.cx);
+
+    edInsertRow(edConfig.cy + 1, tail, sSize);
+    free(tail);
 
     edConfig.cx = 0;
     edConfig.cy++;
 }
 
-char *edPrompt(char *prompt, promptCallback callback)
+/*
+ * Inserts text at (row, col), every '\n' in it starts a new row. Takes time proportional to the
+ * text and the rest of the row, not to the size of the document.
+ */
+void edInsertText(int at, int col, const char *text, int len)
 {
-    size_t bufSize = 128;
-    char *buf = malloc(bufSize);
+    edRow_s *row = edGetRow(at);
 
-    size_t bufLen = 0;
-    buf[0] = '\0';
+    if (!memchr(text, '\n', len))
+    {
+        edRowInsertString(row, col, text, len);
+        return;
+    }
 
-    while (1)
+    // the rest of the row moves to the end of the inserted text
+    int tailLen = row->size - col;
+    char *tail = strndup(&row->string[col], tailLen);
+    assert(tail != NULL);
+    edRowTruncate(row, col);
+
+    const char *p = text;
+    const char *end = text + len;
+    const char *nl;
+    while ((nl = memchr(p, '\n', end - p)) != NULL)
     {
-        edSetStatusMessage(prompt, buf);
-        edRefreshScreen();
+        edRowAppendString(row, p, nl - p);
+        row = docInsertRow(edConfig.buf->doc, ++at);
+        docRowReserve(edConfig.buf->doc, row, 0);
+        row->string[0] = '\0';
+        p = nl + 1;
+    }
+
+    edRowAppendString(row, p, end - p);
+    edRowAppendString(row, tail, tailLen);
+    free(tail);
+    edSetDirty();
+}
 
-        int c = termReadKey();
-        if (c == '\r')
+/*
+ * Deletes text that starts at (row, col), every '\n' in it joins two rows
+ */
+void edDeleteText(int at, int col, const char *text, int len)
+{
+    int lines = 0;
+    int endCol = col;
+    for (int i = 0; i < len; i++)
+    {
+        if (text[i] == '\n')
         {
-            if (bufLen != 0)
-            {
-                edSetStatusMessage("");
-                return buf;
-            }
+            lines++;
+            endCol = 0;
         }
-        else if (c == ESC_KEY)
+        else
         {
-            edSetStatusMessage("");
-            free(buf);
-            return NULL;
+            endCol++;
         }
-        else if (c == BACKSPACE)
+    }
+
+    if (lines == 0)
+    {
+        edRowDeleteString(edGetRow(at), col, len);
+        return;
+    }
+
+    // what is left of the last row joins the first one
+    edRow_s *last = edGetRow(at + lines);
+    int tailLen = last->size - endCol;
+    char *tail = strndup(&last->string[endCol], tailLen);
+    assert(tail != NULL);
+
+    edRow_s *row = edGetRow(at);
+    edRowTruncate(row, col);
+    edRowAppendString(row, tail, tailLen);
+    free(tail);
+
+    // the rows are deleted one after the other, so the gap only moves once
+    for (int i = 0; i < lines; i++) docDeleteRow(edConfig.buf->doc, at + 1);
+    edSetDirty();
+}
+
+/*
+ * Moves the cursor to the end of text that was inserted at the cursor
+ */
+void edCursorAfterText(const char *text, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        if (text[i] == '\n')
         {
-            if (bufLen <= 0) continue;
-            bufLen--;
-            buf[bufLen] = '\0';
+            edConfig.cy++;
+            edConfig.cx = 0;
         }
         else
         {
-            if (bufLen == bufSize - 1)
-            {
-                bufSize *= 2;
-                buf = realloc(buf, bufSize);
-                assert(buf);
-            }
-            if (isalnum(c))
-            {
-                buf[bufLen++] = c;
-                buf[bufLen] = '\0';
-            }
+            edConfig.cx++;
         }
-
-        if (callback) callback(buf, c);
     }
 }
 
 /*
- * Converts the row struct to a normal, NULL-terminated string to be written to file
+ * Inserts the text of a bracketed paste in one go, as a single undo step
  */
-char *edRowsToString(int *bufLen)
+void edPaste()
 {
-    int totLen = 0;
-    for (int i = 0; i < edConfig.numRows; i++)
+    size_t len;
+    char *text = termReadPaste(&len);
+    if (edReadOnly())
     {
-        totLen += edConfig.row[i].size + 1;
+        free(text);
+        return;
     }
-    totLen++; // NULL byte
 
-    *bufLen = totLen;
-    LOG("Total string len: %d", totLen);
+    // terminals send line breaks as "\r", or as "\r\n"
+    size_t textLen = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (text[i] == '\r' && i + 1 < len && text[i + 1] == '\n') continue;
+        text[textLen++] = (text[i] == '\r') ? '\n' : text[i];
+    }
 
-    char *buf = malloc(totLen);
-    assert(buf != NULL);
+    if (textLen == 0 || textLen > INT_MAX)
+    {
+        free(text);
+        return;
+    }
 
-    char *p = buf;
-    for (int i = 0; i < edConfig.numRows; i++)
+    undoBreak(edConfig.buf->undo);
+    if (edConfig.cy == edNumRows())
     {
-        memcpy(p, edConfig.row[i].string, edConfig.row[i].size);
-        p += edConfig.row[i].size;
-        *p = '\n';
-        p++;
+        undoRecord(edConfig.buf->undo, UNDO_ADD_ROW, edNumRows(), 0, "", 0);
+        edInsertRow(edNumRows(), "", 0);
     }
 
-    *p = '\0';
+    undoRecord(edConfig.buf->undo, UNDO_INSERT, edConfig.cy, edConfig.cx, text, textLen);
+    edInsertText(edConfig.cy, edConfig.cx, text, textLen);
+    edCursorAfterText(text, textLen);
+    undoBreak(edConfig.buf->undo);
 
-    return buf;
+    free(text);
 }
 
+void edUndo(void)
+{
+    if (edReadOnly()) return;
 
-void edFind(void)
+    undoOp_s op;
+    bool more = true;
+    bool undone = false;
+
+    while (more && undoUndo(edConfig.buf->undo, &op, &more))
+    {
+        switch (op.type)
+        {
+            case UNDO_INSERT:
+                edDeleteText(op.row, op.col, op.text, op.len);
+                break;
+            case UNDO_DELETE:
+                edInsertText(op.row, op.col, op.text, op.len);
+                break;
+            case UNDO_ADD_ROW:
+                docDeleteRow(edConfig.buf->doc, op.row);
+                edSetDirty();
+                break;
+        }
+
+        edConfig.cy = op.row;
+        edConfig.cx = op.col;
+        undone = true;
+    }
+
+    if (!undone) edSetStatusMessage("Nothing to undo");
+}
+
+void edRedo(void)
 {
-    char *query = edPrompt("Search: %s (Use ESC/Arrows/Enter)", NULL);
-    if (!query) return;
+    if (edReadOnly()) return;
 
-    for (int i = 0; i < edConfig.numRows; i++)
+    undoOp_s op;
+    bool more = true;
+    bool redone = false;
+
+    while (more && undoRedo(edConfig.buf->undo, &op, &more))
     {
-        // case-insensitive search
-        char *res = strcasestr(edConfig.row[i].string, query);
-        if (!res) continue;
-        edConfig.cy = i;
-        edConfig.cx = res - edConfig.row[i].string;
-        break;
+        edConfig.cy = op.row;
+        edConfig.cx = op.col;
+
+        switch (op.type)
+        {
+            case UNDO_INSERT:
+                edInsertText(op.row, op.col, op.text, op.len);
+                edCursorAfterText(op.text, op.len);
+                break;
+            case UNDO_DELETE:
+                edDeleteText(op.row, op.col, op.text, op.len);
+                break;
+            case UNDO_ADD_ROW:
+                edInsertRow(op.row, "", 0);
+                break;
+        }
+
+        redone = true;
     }
 
-    free(query);
+    if (!redone) edSetStatusMessage("Nothing to redo");
 }
 
+char *edPrompt(const char *prompt, promptCallback callback)
+{
+    size_t bufSize = 128;
+    char *buf = malloc(bufSize);
+
+    size_t bufLen = 0;
+    buf[0] = '\0';
 
-void edIncrFind_cb(char *query, int key)
+    while (1)
+    {
+        edSetStatusMessage(prompt, buf);
+        edRefreshScreen();
+
+        // the callback also runs on IDLE_KEY, to show the progress of work in the background
+        int c = edReadKey();
+        switch (c)
+        {
+            case IDLE_KEY:
+                break;
+            case '\r':
+                if (bufLen != 0)
+                {
+                    edSetStatusMessage("");
+                    return buf;
+                }
+                break;
+            case ESC_KEY:
+                edSetStatusMessage("");
+                free(buf);
+                return NULL;
+            case PASTE_START:
+                {
+                    // only the printable part of a paste goes into the prompt
+                    size_t len;
+                    char *text = termReadPaste(&len);
+                    while (bufLen + len >= bufSize)
+                    {
+                        bufSize *= 2;
+                        buf = realloc(buf, bufSize);
+                        assert(buf);
+                    }
+                    for (size_t i = 0; i < len; i++)
+                    {
+                        if ((unsigned char)text[i] < 128 && isprint((unsigned char)text[i])) buf[bufLen++] = text[i];
+                    }
+                    buf[bufLen] = '\0';
+                    free(text);
+                }
+                break;
+            case BACKSPACE:
+                if (bufLen <= 0) continue;
+                bufLen--;
+                buf[bufLen] = '\0';
+                break;
+            default:
+                if (bufLen == bufSize - 1)
+                {
+                    bufSize *= 2;
+                    buf = realloc(buf, bufSize);
+                    assert(buf);
+                }
+                if (c < 128 && isprint(c))
+                {
+                    buf[bufLen++] = c;
+                    buf[bufLen] = '\0';
+                }
+                break;
+        }
+
+        if (callback) callback(buf, c);
+    }
+}
+
+
+void edFind(void)
 {
-    static int prevSearch = 0;
-    static int dir = 1;
-    int startFwd = 0;
-    int startBwd = edConfig.numRows - 1;
+    char *query = edPrompt("Search: %s (/ for regex, ESC to cancel)", NULL);
+    if (!query) return;
 
-    if (key == ARROW_DOWN || key == ARROW_RIGHT)
+    // case-insensitive search
+    search *s = searchNew(query);
+    searchMatch_s match;
+    if (searchError(s))
     {
-        startFwd = prevSearch + 1;
-        dir = 1;
+        edSetStatusMessage("Invalid regex: %s", searchError(s));
     }
-    else if (key == ARROW_UP || key == ARROW_LEFT)
+    else if (edConfig.buf->view ? fileViewFind(edConfig.buf->view, s, 0, 0, &match) : searchFind(s, edConfig.buf->doc, 0, 0, 1, &match))
     {
-        startBwd = prevSearch - 1;
-        dir = -1;
+        edConfig.cy = match.row;
+        edConfig.cx = match.col;
     }
 
-    if (dir == 1)
+    searchFree(&s);
+    free(query);
+}
+
+
+void edIncrFind_cb(char *query, int key)
+{
+    // jump to the first match as soon as the background search finds it
+    static bool jumpToFirst = false;
+    searchMatch_s match;
+
+    if (key == ARROW_DOWN || key == ARROW_RIGHT || key == ARROW_UP || key == ARROW_LEFT)
     {
-        for (int i = startFwd; i < edConfig.numRows; i++)
+        int dir = (key == ARROW_DOWN || key == ARROW_RIGHT) ? 1 : -1;
+        if (searchIndexNext(edConfig.searchIndex, edConfig.cy, edConfig.cx, dir, &match))
         {
-            char *res = strcasestr(edConfig.row[i].string, query);
-            if (!res) continue;
-            edConfig.cy = i;
-            edConfig.cx = res - edConfig.row[i].string;
-            prevSearch = i;
-            break;
+            edConfig.cy = match.row;
+            edConfig.cx = match.col;
         }
+        jumpToFirst = false;
+        return;
     }
-    else
+
+    if (key != IDLE_KEY)
     {
-        for (int i = startBwd; i >= 0; i--)
-        {
-            char *res = strcasestr(edConfig.row[i].string, query);
-            if (!res) continue;
-            edConfig.cy = i;
-            edConfig.cx = res - edConfig.row[i].string;
-            prevSearch = i;
-            break;
-        }
+        searchIndexSetQuery(edConfig.searchIndex, query);
+        jumpToFirst = true;
+    }
 
+    if (jumpToFirst && searchIndexNext(edConfig.searchIndex, 0, -1, 1, &match))
+    {
+        edConfig.cy = match.row;
+        edConfig.cx = match.col;
+        jumpToFirst = false;
     }
 }
 
@@ -742,7 +1112,23 @@ void edIncrementalFind(void)
     int cy = edConfig.cy;
     int rowOff = edConfig.rowOffset;
     int colOff = edConfig.colOffset;
-    char *query = edPrompt("Incremental search: %s (ESC to cancel)", edIncrFind_cb);
+    // a viewed file is not in a document the index can search
+    if (edConfig.buf->view)
+    {
+        edFind();
+        return;
+    }
+
+    edConfig.searchIndex = searchIndexNew(edConfig.buf->doc, eventWake);
+    if (!edConfig.searchIndex)
+    {
+        edSetStatusMessage("Failed to start search");
+        return;
+    }
+
+    char *query = edPrompt("Incremental search: %s (/ for regex, ESC to cancel)", edIncrFind_cb);
+    // the document may only change once the search has stopped
+    searchIndexFree(&edConfig.searchIndex);
     if (!query)
     {
         // restore cursor pos if user cancelled
@@ -755,58 +1141,266 @@ void edIncrementalFind(void)
 }
 
 
-void edOpen(const char *filename)
+/*
+ * Jumps to a line number, to a byte offset in the file (@offset) or to a percentage of the file (n%).
+ * When editing, offsets are those of the document as it is saved, with LF line endings.
+ */
+void edGoto(void)
 {
-    assert(filename != NULL);
+    char *input = edPrompt("Go to: %s (line, @byte or percent%%)", NULL);
+    if (!input) return;
+
+    char *end;
+    const char *number = (input[0] == '@') ? input + 1 : input;
+    errno = 0;
+    unsigned long long value = strtoull(number, &end, 10);
+    bool percent = (*end == '%');
+    if (percent) end++;
+
+    if (!isdigit((unsigned char) number[0]) || *end != '\0' || errno == ERANGE || (percent && input[0] == '@'))
+    {
+        edSetStatusMessage("Invalid position: %s", input);
+    }
+    else if (input[0] == '@')
+    {
+        int row = edRowAtOffset(value);
+        size_t col = (value > edRowOffset(row)) ? value - edRowOffset(row) : 0;
+        edGotoPos(row, (col > INT_MAX) ? INT_MAX : (int) col);
+    }
+    else if (percent)
+    {
+        if (value > 100) value = 100;
+        size_t offset = (size_t) ((double) edSize() * value / 100);
+        edGotoPos(edRowAtOffset(offset), 0);
+    }
+    else
+    {
+        edGotoPos((value > INT_MAX) ? INT_MAX : (int) value - 1, 0);
+    }
+
+    free(input);
+}
+
+
+/**
+ * Buffers
+ */
+
+/*
+ * Adds an empty buffer to the list, without showing it
+ */
+edBuffer_s *edBufferNew()
+{
+    edBuffer_s *b = calloc(1, sizeof(*b));
+    assert(b != NULL);
+    b->doc = docNew();
+    b->undo = undoNew(NED_UNDO_LIMIT);
+
+    edConfig.buffers = realloc(edConfig.buffers, sizeof(*edConfig.buffers) * (edConfig.numBuffers + 1));
+    assert(edConfig.buffers != NULL);
+    edConfig.buffers[edConfig.numBuffers++] = b;
+
+    return b;
+}
+
+/*
+ * Shows a buffer. The renders of the one that was shown are left to age out of the render cache.
+ */
+void edShowBuffer(edBuffer_s *b)
+{
+    if (b == edConfig.buf) return;
+
+    if (edConfig.buf)
+    {
+        undoBreak(edConfig.buf->undo);
+        edConfig.buf->cursor = (struct edCursorPos_s){ edConfig.cx, edConfig.cy, edConfig.rowOffset, edConfig.colOffset };
+    }
+
+    edConfig.buf = b;
+    edConfig.cx = b->cursor.cx;
+    edConfig.cy = b->cursor.cy;
+    edConfig.rowOffset = b->cursor.rowOffset;
+    edConfig.colOffset = b->cursor.colOffset;
+}
+
+/*
+ * Shows the buffer step places after the current one in the list, wrapping around
+ */
+void edSwitchBuffer(int step)
+{
+    if (edConfig.numBuffers < 2)
+    {
+        edSetStatusMessage("No other buffers open");
+        return;
+    }
+
+    int i = edBufferIndex(edConfig.buf) + step;
+    i = ((i % edConfig.numBuffers) + edConfig.numBuffers) % edConfig.numBuffers;
+    edShowBuffer(edConfig.buffers[i]);
+    edSetStatusMessage("Buffer %d of %d: %s", i + 1, edConfig.numBuffers, edBufferName(edConfig.buf));
+}
+
+/*
+ * True if both names refer to the same file, which they also do through a different path or a
+ * symlink. Names of files that don't exist (yet) are compared as they are.
+ */
+static bool edSameFile(const char *a, const char *b)
+{
+    struct stat sa, sb;
+    if (stat(a, &sa) == -1 || stat(b, &sb) == -1) return strcmp(a, b) == 0;
+    return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
 
-    FILE *inputFile = fopen(filename, "r");
-    if (!inputFile) errExit("Failed to open file: %s", filename);
-    free(edConfig.filename);
-    edConfig.filename = strdup(filename);
+/*
+ * Opens a file in a new buffer and shows it. A file that is already open is only shown.
+ * A viewed file is read-only, and only the part on screen is read. Returns -1 if the file
+ * can't be read.
+ */
+int edOpen(const char *filename, bool view)
+{
+    assert(filename != NULL);
 
-    char *line = NULL;
-    size_t bufferSize = 0;
-    ssize_t lineLen = 0;
-    while ((lineLen = getline(&line, &bufferSize, inputFile)) != -1)
+    for (int i = 0; i < edConfig.numBuffers; i++)
     {
-        // TODO(noxet): hack to avoid BO, fix later with reallocations
-        if (edConfig.numRows >= 1000) break;
+        edBuffer_s *b = edConfig.buffers[i];
+        if (b->filename && edSameFile(b->filename, filename))
+        {
+            edShowBuffer(b);
+            return 0;
+        }
+    }
 
-        // remove newline char(s) if present and terminate string
-        while (lineLen > 0 && (line[lineLen - 1] == '\n' || line[lineLen - 1] == '\r')) lineLen--;
-        edInsertRow(edConfig.numRows, line, lineLen);
+    fileView *fv = NULL;
+    document *doc = docNew();
+    if (view)
+    {
+        // the lines are counted in the background, the status bar shows how far it got
+        fv = fileViewNew(filename, eventWake);
+        if (!fv)
+        {
+            docFree(&doc);
+            return -1;
+        }
     }
+    else if (docLoadFile(doc, filename) == -1)
+    {
+        int savedErrno = errno;
+        docFree(&doc);
+        errno = savedErrno;
+        return -1;
+    }
+
+    edBuffer_s *b = edBufferNew();
+    docFree(&b->doc);
+    b->doc = doc;
+    b->view = fv;
+    b->filename = strdup(filename);
+    edShowBuffer(b);
+
+    return 0;
+}
+
+void edOpenPrompt(void)
+{
+    char *filename = edPrompt("Open: %s (ESC to cancel)", NULL);
+    if (!filename) return;
+
+    if (edOpen(filename, false) == -1) edSetStatusMessage("Failed to open %s: %s", filename, strerror(errno));
+    free(filename);
+}
 
-    free(line);
-    fclose(inputFile);
+/*
+ * A buffer with unsaved changes, the current one if it has any. NULL if all are saved.
+ */
+edBuffer_s *edUnsavedBuffer()
+{
+    if (edConfig.buf->dirty) return edConfig.buf;
 
-    // since we call appendRow here, it will be falsely set to dirty
-    edConfig.dirty = false;
+    for (int i = 0; i < edConfig.numBuffers; i++)
+    {
+        if (edConfig.buffers[i]->dirty) return edConfig.buffers[i];
+    }
+
+    return NULL;
 }
 
 void edSaveFile(const char *filename)
 {
+    if (edReadOnly()) return;
+
+    if (edConfig.buf->saveJob)
+    {
+        edSetStatusMessage("A save is already in progress");
+        return;
+    }
+
     if (filename == NULL)
     {
-        filename = edPrompt("Enter filename: %s", NULL);
-        if (filename == NULL)
+        char *newName = edPrompt("Enter filename: %s", NULL);
+        if (newName == NULL)
         {
             edSetStatusMessage("Save aborted!");
             return;
         }
+
+        // later saves go to the same file
+        free(edConfig.buf->filename);
+        edConfig.buf->filename = newName;
+        filename = newName;
+    }
+
+    // the file is written on a worker thread, from a snapshot of the document
+    edConfig.buf->saveJob = saveJobStart(edConfig.buf->doc, filename, eventWake);
+    if (!edConfig.buf->saveJob)
+    {
+        edSetStatusMessage("Failed to start saving %s", filename);
+        return;
     }
 
-    int bufLen = 0;
-    char *content = edRowsToString(&bufLen);
+    edConfig.buf->saveChanges = edConfig.buf->changes;
+    edSetStatusMessage("Saving %s...", filename);
+}
 
-    FILE *fd = fopen(filename, "w");
-    if (!fd) errExit("Failed to open file: %s", filename);
-    int ret = fwrite(content, 1, bufLen, fd);
-    if (ret != bufLen) errExit("Failed to save all bytes to file: %s", filename);
-    fclose(fd);
-    free(content);
-    edConfig.dirty = false;
-    edSetStatusMessage("File saved successfully");
+static void edSaveTimer()
+{
+    edConfig.saveTimer = -1;
+}
+
+/*
+ * Shows the progress of the background saves, and completes those that are done
+ */
+void edUpdateSave()
+{
+    bool saving = false;
+
+    for (int i = 0; i < edConfig.numBuffers; i++)
+    {
+        edBuffer_s *b = edConfig.buffers[i];
+        if (!b->saveJob) continue;
+
+        if (!saveJobDone(b->saveJob))
+        {
+            if (b == edConfig.buf) edSetStatusMessage("Saving... %d%%", saveJobProgress(b->saveJob));
+            saving = true;
+            continue;
+        }
+
+        int error = saveJobFinish(&b->saveJob);
+        if (error)
+        {
+            edSetStatusMessage("Failed to save %s: %s", b->filename, strerror(error));
+            continue;
+        }
+
+        // edits made after the snapshot was taken are not in the file
+        if (b->changes == b->saveChanges) b->dirty = false;
+        if (b == edConfig.buf) edSetStatusMessage("File saved successfully");
+        else edSetStatusMessage("Saved %s", b->filename);
+    }
+
+    // the jobs wake us up when they are done, the timer only updates the progress
+    if (!saving) eventTimerStop(&edConfig.saveTimer);
+    else if (edConfig.saveTimer == -1) edConfig.saveTimer = eventTimerStart(NED_IDLE_MS, edSaveTimer);
 }
 
 void edInit()
@@ -814,52 +1408,179 @@ void edInit()
     edConfig.cx = 0;
     edConfig.cy = 0;
     edConfig.rx = 0;
-    edConfig.row = calloc(1000, sizeof(*edConfig.row));
-    edConfig.numRows = 0;
     edConfig.rowOffset = 0;
     edConfig.colOffset = 0;
-    edConfig.filename = NULL;
     edConfig.statusMsg[0] = '\0';
     edConfig.statusMsgTime = 0;
-    edConfig.dirty = false;
+    edConfig.statusTimer = -1;
+    edConfig.saveTimer = -1;
+    edConfig.buffers = NULL;
+    edConfig.numBuffers = 0;
+    edConfig.buf = NULL;
+    edConfig.drawnBuf = NULL;
+    edConfig.drawnRowOffset = 0;
 
-    // TODO(noxet): Handle window resize event
     if (termGetWindowSize(&edConfig.winRows, &edConfig.winCols) == -1) errExit("Failed to get window size");
     // make room for the status bar and messages at the end
     // TODO(noxet): Fix this later by using "pane" size or similar, which is independent of window size
     edConfig.winRows -= 2;
+    edConfig.screen = screenNew(edConfig.winRows + 2, edConfig.winCols);
+    edConfig.frame = astringNew();
+    renderCacheResize(edConfig.winRows);
+
+    LOG("window size, rows: %d, cols: %d\n", edConfig.winRows, edConfig.winCols);
+}
+
+/*
+ * Lays out the screen again for the new window size
+ */
+void edResize()
+{
+    int rows, cols;
+    if (termGetWindowSize(&rows, &cols) == -1) return;
+
+    // leave at least one text row next to the status bar and messages
+    if (rows < 3) rows = 3;
+    edConfig.winRows = rows - 2;
+    edConfig.winCols = cols;
+
+    screenFree(&edConfig.screen);
+    edConfig.screen = screenNew(rows, cols);
+    renderCacheResize(edConfig.winRows);
+    termWrite(DISPLAY_ERASE_ALL_CMD, DISPLAY_ERASE_ALL_LEN);
+
+    LOG("window resized, rows: %d, cols: %d\n", edConfig.winRows, edConfig.winCols);
+}
 
+/*
+ * Runs the editor on the keys of a script instead of the terminal, and reports how long every
+ * key took to handle and draw
+ */
+void edReplay(replay *r)
+{
+    edRefreshScreen();
+
+    while (nedRunning && termInputPending())
+    {
+        replayStartKey(r, termBytesWritten());
+        edProcessKey();
+        edUpdateSave();
+        edRefreshScreen();
+        replayEndKey(r, termBytesWritten());
+    }
+}
 
-    printf("window size, rows: %d, cols: %d\n", edConfig.winRows, edConfig.winCols);
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--replay script [--capture file] [--size ROWSxCOLS]] [--view] [file...]\n", prog);
+    exit(EXIT_FAILURE);
 }
 
 int main(int argc, char *argv[])
 {
+    static struct option options[] =
+    {
+        { "replay", required_argument, NULL, 'r' },
+        { "capture", required_argument, NULL, 'c' },
+        { "size", required_argument, NULL, 's' },
+        { "view", no_argument, NULL, 'v' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    const char *script = NULL;
+    const char *capture = "/dev/null";
+    int rows = 24;
+    int cols = 80;
+    bool view = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'r':
+                script = optarg;
+                break;
+            case 'c':
+                capture = optarg;
+                break;
+            case 's':
+                if (sscanf(optarg, "%dx%d", &rows, &cols) != 2 || rows < 3 || cols < 1) usage(argv[0]);
+                break;
+            case 'v':
+                view = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    replay *r = NULL;
+    if (script)
+    {
+        r = replayNew(script);
+        if (!r) return EXIT_FAILURE;
+
+        int outFd = open(capture, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (outFd == -1)
+        {
+            perror(capture);
+            return EXIT_FAILURE;
+        }
+
+        size_t keysLen;
+        const char *keys = replayKeys(r, &keysLen);
+        termSetHeadless(keys, keysLen, outFd, rows, cols);
+    }
+
     logFile = fopen("ned.log", "w");
 
     if (termEnableRawMode() == -1) errExit("Failed to set raw mode");
     if (termSetupSignals() == -1) errExit("Failed to set up signal handler");
+    if (eventInit() == -1) errExit("Failed to set up the event loop");
 
     edInit();
-    if (argc >= 2)
+    for (int i = optind; i < argc; i++)
     {
-        edOpen(argv[1]);
+        if (edOpen(argv[i], view) == -1) errExit("Failed to open file: %s", argv[i]);
     }
+    if (edConfig.numBuffers == 0) edShowBuffer(edBufferNew());
+    // the first file is shown
+    edShowBuffer(edConfig.buffers[0]);
 
     // disable stdout buffering
     setbuf(stdout, NULL);
 
-    edSetStatusMessage("HELP: CTRL-W to save | CTRL-F to find | CTRL-Q to quit");
+    edSetStatusMessage("HELP: CTRL-W to save | CTRL-F to find | CTRL-Z/Y to undo/redo | CTRL-Q to quit");
 
-    while (nedRunning)
+    if (r)
     {
-        edRefreshScreen();
-        edProcessKey();
+        edReplay(r);
+        replayReport(r, stdout);
+        replayFree(&r);
     }
+    else
+    {
+        while (nedRunning)
+        {
+            edUpdateSave();
+            edRefreshScreen();
 
-    if (termDisableRawMode() == -1) errExit("Restoring userTerm failed");
-
+            // handle all keys that have already arrived before drawing again
+            do
+            {
+                edProcessKey();
+            } while (nedRunning && termInputPending());
+        }
+    }
 
+    // let the saves that are still running complete
+    if (termDisableRawMode() == -1) errExit("Restoring userTerm failed");
+    for (int i = 0; i < edConfig.numBuffers; i++)
+    {
+        edBuffer_s *b = edConfig.buffers[i];
+        int saveError = b->saveJob ? saveJobFinish(&b->saveJob) : 0;
+        if (saveError) fprintf(stderr, "Failed to save %s: %s\n", b->filename, strerror(saveError));
+    }
 
     return 0;
 }
@@ -0,0 +1,937 @@
+#include "regexp.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+/*
+ * Case-insensitive regular expressions, matched with lazily built DFAs.
+ *
+ * Supported syntax: literals, '.', [classes] with ranges and negation, \d \w \s (and \D \W \S),
+ * the anchors ^ and $, grouping with (), alternation with |, and the repetitions * + ? {m} {m,} {m,n}.
+ *
+ * The pattern is parsed into a tree, which is compiled into two Thompson NFAs: one for the
+ * pattern and one for the pattern reversed. DFA states (sets of NFA states) are only created when
+ * the input needs them, and the cache is flushed when it grows too large. Every input byte is
+ * therefore handled in constant time, and there is no backtracking that can blow up.
+ *
+ * The text is matched a line at a time. The start and the end of the line are fed to the automata
+ * as two extra symbols, which is how ^ and $ are matched. Finding a match takes a forward pass to
+ * see if there is one, and a backward pass with the reversed pattern to find where it starts.
+ */
+
+#define RX_BOL          256     // start of line symbol
+#define RX_EOL          257     // end of line symbol
+#define RX_SYMBOLS      258
+#define RX_SET_WORDS    ((RX_SYMBOLS + 63) / 64)
+
+#define RX_MAX_NODES    4096
+#define RX_MAX_NFA      16384
+#define RX_MAX_REPEAT   100
+#define RX_MAX_DFA      1024    // cached DFA states, per automaton
+#define RX_TABLE_SIZE   (RX_MAX_DFA * 2)
+
+typedef struct
+{
+    uint64_t bits[RX_SET_WORDS];
+} rxSet_s;
+
+typedef enum
+{
+    RX_NODE_EMPTY,
+    RX_NODE_SET,
+    RX_NODE_CONCAT,
+    RX_NODE_ALT,
+    RX_NODE_STAR,
+    RX_NODE_PLUS,
+    RX_NODE_QUEST,
+    RX_NODE_REPEAT,
+} rxNodeType_e;
+
+typedef struct
+{
+    rxNodeType_e type;
+    int left;
+    int right;
+    int set;
+    int min;
+    int max;            // -1 if unbounded
+} rxNode_s;
+
+typedef enum
+{
+    RX_NFA_SET,         // consumes a symbol from set, then goes to out
+    RX_NFA_SPLIT,       // goes to both out and out1 without consuming anything
+    RX_NFA_MATCH,
+} rxNfaType_e;
+
+typedef struct
+{
+    rxNfaType_e type;
+    int set;
+    int out;
+    int out1;
+} rxNfaState_s;
+
+typedef struct
+{
+    int setOffset;      // sorted NFA states, in the automaton's pool
+    int setLen;
+    bool accept;
+    int next[RX_SYMBOLS];   // -1 until the transition has been computed
+} rxDfaState_s;
+
+typedef struct
+{
+    int nfaStart;
+    bool unanchored;    // a new match can start at any position
+    rxDfaState_s *states;
+    int numStates;
+    int *pool;
+    int poolLen;
+    int poolCapacity;
+    int table[RX_TABLE_SIZE];   // hash table of state ids, -1 if empty
+    int start[2];       // start states, indexed by atBol. -1 until computed
+    int flushes;        // times the cache was flushed, which invalidates the state ids
+} rxDfa_s;
+
+struct regexp_s
+{
+    rxNode_s *nodes;
+    int numNodes;
+    rxSet_s *sets;
+    int numSets;
+    rxNfaState_s *nfa;
+    int numNfa;
+
+    rxDfa_s forward;    // pattern, unanchored
+    rxDfa_s reverse;    // reversed pattern, unanchored
+    rxDfa_s anchored;   // pattern, anchored at the start position
+
+    // scratch space for computing DFA states
+    int *stack;
+    int *found;
+    unsigned *mark;
+    unsigned markGen;
+
+    const char *pattern;
+    const char *error;
+};
+
+
+/**
+ * Parser
+ */
+
+static inline void rxSetAdd(rxSet_s *set, int sym)
+{
+    set->bits[sym / 64] |= (uint64_t) 1 << (sym % 64);
+}
+
+static inline bool rxSetHas(const rxSet_s *set, int sym)
+{
+    return (set->bits[sym / 64] >> (sym % 64)) & 1;
+}
+
+static int rxNewNode(regexp *re, rxNodeType_e type, int left, int right)
+{
+    if (re->numNodes == RX_MAX_NODES)
+    {
+        re->error = "pattern too long";
+        return -1;
+    }
+
+    rxNode_s *node = &re->nodes[re->numNodes];
+    node->type = type;
+    node->left = left;
+    node->right = right;
+    node->set = -1;
+    node->min = 0;
+    node->max = 0;
+
+    return re->numNodes++;
+}
+
+static int rxNewSet(regexp *re)
+{
+    re->sets = realloc(re->sets, sizeof(*re->sets) * (re->numSets + 1));
+    assert(re->sets != NULL);
+    memset(&re->sets[re->numSets], 0, sizeof(*re->sets));
+
+    return re->numSets++;
+}
+
+/*
+ * Adds a byte to the set, in both upper and lower case
+ */
+static void rxSetAddFolded(rxSet_s *set, int c)
+{
+    rxSetAdd(set, c);
+    if (isalpha(c))
+    {
+        rxSetAdd(set, tolower(c));
+        rxSetAdd(set, toupper(c));
+    }
+}
+
+static void rxSetAddClass(rxSet_s *set, char cls)
+{
+    for (int c = 0; c < 256; c++)
+    {
+        bool in = false;
+        switch (tolower(cls))
+        {
+            case 'd': in = isdigit(c); break;
+            case 'w': in = isalnum(c) || c == '_'; break;
+            case 's': in = isspace(c); break;
+        }
+
+        // upper case classes are negated
+        if (isupper(cls)) in = !in;
+        if (in) rxSetAdd(set, c);
+    }
+}
+
+static inline bool rxIsClassEscape(char c)
+{
+    return c && strchr("dDwWsS", c) != NULL;
+}
+
+static char rxEscapedChar(char c)
+{
+    switch (c)
+    {
+        case 't': return '\t';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        default: return c;
+    }
+}
+
+static int rxParseAlt(regexp *re, const char **p);
+
+static int rxParseClass(regexp *re, const char **p)
+{
+    int setIdx = rxNewSet(re);
+    rxSet_s set = { 0 };
+    bool negate = false;
+
+    if (**p == '^')
+    {
+        negate = true;
+        (*p)++;
+    }
+
+    // a ']' right at the start is a literal
+    bool first = true;
+    while (**p && (**p != ']' || first))
+    {
+        first = false;
+        int lo = (unsigned char) *(*p)++;
+        if (lo == '\\')
+        {
+            if (!**p) break;
+            char esc = *(*p)++;
+            if (rxIsClassEscape(esc))
+            {
+                rxSetAddClass(&set, esc);
+                continue;
+            }
+            lo = (unsigned char) rxEscapedChar(esc);
+        }
+
+        int hi = lo;
+        if ((*p)[0] == '-' && (*p)[1] && (*p)[1] != ']')
+        {
+            (*p)++;
+            hi = (unsigned char) *(*p)++;
+            if (hi == '\\' && **p) hi = (unsigned char) rxEscapedChar(*(*p)++);
+            if (hi < lo)
+            {
+                re->error = "invalid range in character class";
+                return -1;
+            }
+        }
+
+        for (int c = lo; c <= hi; c++) rxSetAddFolded(&set, c);
+    }
+
+    if (**p != ']')
+    {
+        re->error = "missing ]";
+        return -1;
+    }
+    (*p)++;
+
+    if (negate)
+    {
+        rxSet_s negated = { 0 };
+        for (int c = 0; c < 256; c++)
+        {
+            if (!rxSetHas(&set, c)) rxSetAdd(&negated, c);
+        }
+        set = negated;
+    }
+
+    re->sets[setIdx] = set;
+    int node = rxNewNode(re, RX_NODE_SET, -1, -1);
+    if (node != -1) re->nodes[node].set = setIdx;
+
+    return node;
+}
+
+static int rxParseAtom(regexp *re, const char **p)
+{
+    char c = **p;
+
+    if (c == '(')
+    {
+        (*p)++;
+        int node = rxParseAlt(re, p);
+        if (node == -1) return -1;
+        if (**p != ')')
+        {
+            re->error = "missing )";
+            return -1;
+        }
+        (*p)++;
+        return node;
+    }
+
+    if (c == '[')
+    {
+        (*p)++;
+        return rxParseClass(re, p);
+    }
+
+    int setIdx = rxNewSet(re);
+    rxSet_s *set = &re->sets[setIdx];
+    (*p)++;
+
+    switch (c)
+    {
+        case '.':
+            for (int i = 0; i < 256; i++) rxSetAdd(set, i);
+            break;
+        case '^':
+            rxSetAdd(set, RX_BOL);
+            break;
+        case '$':
+            rxSetAdd(set, RX_EOL);
+            break;
+        case '\\':
+            if (!**p)
+            {
+                re->error = "trailing \\";
+                return -1;
+            }
+            c = *(*p)++;
+            if (rxIsClassEscape(c)) rxSetAddClass(set, c);
+            else rxSetAddFolded(set, (unsigned char) rxEscapedChar(c));
+            break;
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+            re->error = "nothing to repeat";
+            return -1;
+        default:
+            rxSetAddFolded(set, (unsigned char) c);
+            break;
+    }
+
+    int node = rxNewNode(re, RX_NODE_SET, -1, -1);
+    if (node != -1) re->nodes[node].set = setIdx;
+
+    return node;
+}
+
+static bool rxParseNumber(const char **p, int *n)
+{
+    if (!isdigit((unsigned char) **p)) return false;
+
+    *n = 0;
+    while (isdigit((unsigned char) **p))
+    {
+        *n = *n * 10 + (*(*p)++ - '0');
+        if (*n > RX_MAX_REPEAT) *n = RX_MAX_REPEAT + 1;
+    }
+
+    return true;
+}
+
+static int rxParseRepeat(regexp *re, const char **p)
+{
+    int node = rxParseAtom(re, p);
+
+    while (node != -1)
+    {
+        char c = **p;
+        if (c == '*') node = rxNewNode(re, RX_NODE_STAR, node, -1);
+        else if (c == '+') node = rxNewNode(re, RX_NODE_PLUS, node, -1);
+        else if (c == '?') node = rxNewNode(re, RX_NODE_QUEST, node, -1);
+        else if (c == '{')
+        {
+            // {m}, {m,} or {m,n}
+            (*p)++;
+            int min = 0;
+            int max = 0;
+            if (!rxParseNumber(p, &min))
+            {
+                re->error = "invalid repetition";
+                return -1;
+            }
+
+            max = min;
+            if (**p == ',')
+            {
+                (*p)++;
+                if (!rxParseNumber(p, &max)) max = -1;
+            }
+
+            if (**p != '}' || (max != -1 && max < min))
+            {
+                re->error = "invalid repetition";
+                return -1;
+            }
+
+            if (min > RX_MAX_REPEAT || max > RX_MAX_REPEAT)
+            {
+                re->error = "repetition count too large";
+                return -1;
+            }
+
+            node = rxNewNode(re, RX_NODE_REPEAT, node, -1);
+            if (node != -1)
+            {
+                re->nodes[node].min = min;
+                re->nodes[node].max = max;
+            }
+        }
+        else break;
+
+        (*p)++;
+    }
+
+    return node;
+}
+
+static int rxParseConcat(regexp *re, const char **p)
+{
+    int node = rxNewNode(re, RX_NODE_EMPTY, -1, -1);
+
+    while (node != -1 && **p && **p != '|' && **p != ')')
+    {
+        int next = rxParseRepeat(re, p);
+        if (next == -1) return -1;
+        node = rxNewNode(re, RX_NODE_CONCAT, node, next);
+    }
+
+    return node;
+}
+
+static int rxParseAlt(regexp *re, const char **p)
+{
+    int node = rxParseConcat(re, p);
+
+    while (node != -1 && **p == '|')
+    {
+        (*p)++;
+        int next = rxParseConcat(re, p);
+        if (next == -1) return -1;
+        node = rxNewNode(re, RX_NODE_ALT, node, next);
+    }
+
+    return node;
+}
+
+
+/**
+ * NFA
+ */
+
+static int rxNewNfaState(regexp *re, rxNfaType_e type, int set, int out, int out1)
+{
+    if (re->numNfa == RX_MAX_NFA)
+    {
+        re->error = "pattern too complex";
+        return -1;
+    }
+
+    re->nfa = realloc(re->nfa, sizeof(*re->nfa) * (re->numNfa + 1));
+    assert(re->nfa != NULL);
+    re->nfa[re->numNfa] = (rxNfaState_s) { type, set, out, out1 };
+
+    return re->numNfa++;
+}
+
+/*
+ * Compiles the tree below node into NFA states that continue to next, and returns the first state.
+ * With reverse set, the NFA matches the reversed pattern.
+ */
+static int rxCompile(regexp *re, int node, int next, bool reverse)
+{
+    if (next == -1) return -1;
+
+    rxNode_s *n = &re->nodes[node];
+    int left = n->left;
+    int right = n->right;
+
+    switch (n->type)
+    {
+        case RX_NODE_EMPTY:
+            return next;
+        case RX_NODE_SET:
+            return rxNewNfaState(re, RX_NFA_SET, n->set, next, -1);
+        case RX_NODE_CONCAT:
+            if (reverse) return rxCompile(re, right, rxCompile(re, left, next, reverse), reverse);
+            return rxCompile(re, left, rxCompile(re, right, next, reverse), reverse);
+        case RX_NODE_ALT:
+            {
+                int a = rxCompile(re, left, next, reverse);
+                int b = rxCompile(re, right, next, reverse);
+                if (a == -1 || b == -1) return -1;
+                return rxNewNfaState(re, RX_NFA_SPLIT, -1, a, b);
+            }
+        case RX_NODE_STAR:
+            {
+                int split = rxNewNfaState(re, RX_NFA_SPLIT, -1, -1, next);
+                if (split == -1) return -1;
+                int body = rxCompile(re, left, split, reverse);
+                if (body == -1) return -1;
+                re->nfa[split].out = body;
+                return split;
+            }
+        case RX_NODE_PLUS:
+            {
+                int split = rxNewNfaState(re, RX_NFA_SPLIT, -1, -1, next);
+                if (split == -1) return -1;
+                int body = rxCompile(re, left, split, reverse);
+                if (body == -1) return -1;
+                re->nfa[split].out = body;
+                return body;
+            }
+        case RX_NODE_QUEST:
+            {
+                int body = rxCompile(re, left, next, reverse);
+                if (body == -1) return -1;
+                return rxNewNfaState(re, RX_NFA_SPLIT, -1, body, next);
+            }
+        case RX_NODE_REPEAT:
+            {
+                // x{2,4} is compiled as xx(x(x)?)? and x{2,} as xxx*
+                int min = n->min;
+                int max = n->max;
+                int start = next;
+                if (max == -1)
+                {
+                    int split = rxNewNfaState(re, RX_NFA_SPLIT, -1, -1, next);
+                    if (split == -1) return -1;
+                    int body = rxCompile(re, left, split, reverse);
+                    if (body == -1) return -1;
+                    re->nfa[split].out = body;
+                    start = split;
+                }
+                else
+                {
+                    for (int i = min; i < max && start != -1; i++)
+                    {
+                        int body = rxCompile(re, left, start, reverse);
+                        if (body == -1) return -1;
+                        start = rxNewNfaState(re, RX_NFA_SPLIT, -1, body, next);
+                    }
+                }
+
+                for (int i = 0; i < min && start != -1; i++) start = rxCompile(re, left, start, reverse);
+                return start;
+            }
+    }
+
+    return -1;
+}
+
+
+/**
+ * Lazy DFA
+ */
+
+static void rxDfaInit(rxDfa_s *dfa, int nfaStart, bool unanchored)
+{
+    dfa->nfaStart = nfaStart;
+    dfa->unanchored = unanchored;
+    dfa->states = NULL;
+    dfa->numStates = 0;
+    dfa->pool = NULL;
+    dfa->poolLen = 0;
+    dfa->poolCapacity = 0;
+    memset(dfa->table, -1, sizeof(dfa->table));
+    dfa->start[0] = dfa->start[1] = -1;
+    dfa->flushes = 0;
+}
+
+static void rxDfaFree(rxDfa_s *dfa)
+{
+    free(dfa->states);
+    free(dfa->pool);
+}
+
+/*
+ * Forgets all cached states, to keep the memory use bounded
+ */
+static void rxDfaFlush(rxDfa_s *dfa)
+{
+    dfa->numStates = 0;
+    dfa->poolLen = 0;
+    memset(dfa->table, -1, sizeof(dfa->table));
+    dfa->start[0] = dfa->start[1] = -1;
+    dfa->flushes++;
+}
+
+/*
+ * Adds the NFA state and everything reachable from it without consuming input to re->found
+ */
+static void rxClosure(regexp *re, int state, int *numFound)
+{
+    int top = 0;
+    re->stack[top++] = state;
+
+    while (top)
+    {
+        int s = re->stack[--top];
+        if (re->mark[s] == re->markGen) continue;
+        re->mark[s] = re->markGen;
+
+        if (re->nfa[s].type == RX_NFA_SPLIT)
+        {
+            re->stack[top++] = re->nfa[s].out1;
+            re->stack[top++] = re->nfa[s].out;
+        }
+        else
+        {
+            re->found[(*numFound)++] = s;
+        }
+    }
+}
+
+static int rxCompareInt(const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+static uint32_t rxHashSet(const int *set, int len)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < len; i++)
+    {
+        hash ^= (uint32_t) set[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/*
+ * Returns the DFA state for the NFA states in re->found, creating it if needed
+ */
+static int rxDfaState(regexp *re, rxDfa_s *dfa, int numFound)
+{
+    qsort(re->found, numFound, sizeof(*re->found), rxCompareInt);
+
+    uint32_t hash = rxHashSet(re->found, numFound);
+    int slot = hash & (RX_TABLE_SIZE - 1);
+    while (dfa->table[slot] != -1)
+    {
+        rxDfaState_s *state = &dfa->states[dfa->table[slot]];
+        if (state->setLen == numFound &&
+                memcmp(&dfa->pool[state->setOffset], re->found, sizeof(int) * numFound) == 0)
+        {
+            return dfa->table[slot];
+        }
+        slot = (slot + 1) & (RX_TABLE_SIZE - 1);
+    }
+
+    if (dfa->numStates == RX_MAX_DFA)
+    {
+        rxDfaFlush(dfa);
+        slot = hash & (RX_TABLE_SIZE - 1);
+    }
+
+    if (dfa->states == NULL)
+    {
+        dfa->states = malloc(sizeof(*dfa->states) * RX_MAX_DFA);
+        assert(dfa->states != NULL);
+    }
+
+    if (dfa->poolLen + numFound > dfa->poolCapacity)
+    {
+        dfa->poolCapacity = (dfa->poolCapacity + numFound) * 2;
+        dfa->pool = realloc(dfa->pool, sizeof(*dfa->pool) * dfa->poolCapacity);
+        assert(dfa->pool != NULL);
+    }
+
+    int id = dfa->numStates++;
+    rxDfaState_s *state = &dfa->states[id];
+    state->setOffset = dfa->poolLen;
+    state->setLen = numFound;
+    state->accept = false;
+    for (int i = 0; i < numFound; i++)
+    {
+        if (re->nfa[re->found[i]].type == RX_NFA_MATCH) state->accept = true;
+    }
+    memset(state->next, -1, sizeof(state->next));
+    memcpy(&dfa->pool[dfa->poolLen], re->found, sizeof(int) * numFound);
+    dfa->poolLen += numFound;
+    dfa->table[slot] = id;
+
+    return id;
+}
+
+/*
+ * Collects the NFA states reached from the DFA state by consuming sym
+ */
+static void rxMove(regexp *re, rxDfa_s *dfa, int id, int sym, int *numFound)
+{
+    rxDfaState_s *state = &dfa->states[id];
+    for (int i = 0; i < state->setLen; i++)
+    {
+        rxNfaState_s *s = &re->nfa[dfa->pool[state->setOffset + i]];
+        if (s->type == RX_NFA_SET && rxSetHas(&re->sets[s->set], sym)) rxClosure(re, s->out, numFound);
+    }
+}
+
+/*
+ * The state to start matching in. An anchored match at the start of the line may or may not
+ * begin with the start of line symbol, so both are allowed.
+ */
+static int rxDfaStart(regexp *re, rxDfa_s *dfa, bool atBol)
+{
+    if (dfa->start[atBol] != -1) return dfa->start[atBol];
+
+    int numFound = 0;
+    re->markGen++;
+    rxClosure(re, dfa->nfaStart, &numFound);
+    int id = rxDfaState(re, dfa, numFound);
+
+    if (atBol)
+    {
+        rxMove(re, dfa, id, RX_BOL, &numFound);
+        id = rxDfaState(re, dfa, numFound);
+    }
+
+    dfa->start[atBol] = id;
+    return id;
+}
+
+static int rxDfaStep(regexp *re, rxDfa_s *dfa, int id, int sym)
+{
+    int next = dfa->states[id].next[sym];
+    if (next != -1) return next;
+
+    int numFound = 0;
+    re->markGen++;
+    rxMove(re, dfa, id, sym, &numFound);
+    if (dfa->unanchored) rxClosure(re, dfa->nfaStart, &numFound);
+
+    int flushes = dfa->flushes;
+    next = rxDfaState(re, dfa, numFound);
+    // the cache may have been flushed, then id is no longer valid
+    if (dfa->flushes == flushes) dfa->states[id].next[sym] = next;
+
+    return next;
+}
+
+
+/**
+ * Public interface
+ */
+
+/*
+ * Compiles the pattern. On failure NULL is returned, and error describes the problem.
+ */
+regexp *regexpCompile(const char *pattern, const char **error)
+{
+    regexp *re = calloc(1, sizeof(*re));
+    assert(re != NULL);
+    re->nodes = malloc(sizeof(*re->nodes) * RX_MAX_NODES);
+    assert(re->nodes != NULL);
+
+    const char *p = pattern;
+    int root = rxParseAlt(re, &p);
+    if (root != -1 && *p == ')')
+    {
+        re->error = "unmatched )";
+        root = -1;
+    }
+
+    int forwardStart = -1;
+    int reverseStart = -1;
+    if (root != -1)
+    {
+        int match = rxNewNfaState(re, RX_NFA_MATCH, -1, -1, -1);
+        forwardStart = rxCompile(re, root, match, false);
+        reverseStart = rxCompile(re, root, match, true);
+    }
+
+    // the tree is not needed once the NFAs are built
+    free(re->nodes);
+    re->nodes = NULL;
+
+    if (forwardStart == -1 || reverseStart == -1)
+    {
+        if (error) *error = re->error ? re->error : "invalid pattern";
+        regexpFree(&re);
+        return NULL;
+    }
+
+    re->stack = malloc(sizeof(*re->stack) * re->numNfa * 2);
+    re->found = malloc(sizeof(*re->found) * re->numNfa);
+    re->mark = calloc(re->numNfa, sizeof(*re->mark));
+    assert(re->stack != NULL && re->found != NULL && re->mark != NULL);
+
+    rxDfaInit(&re->forward, forwardStart, true);
+    rxDfaInit(&re->reverse, reverseStart, true);
+    rxDfaInit(&re->anchored, forwardStart, false);
+
+    return re;
+}
+
+void regexpFree(regexp **re)
+{
+    if (*re == NULL) return;
+
+    rxDfaFree(&(*re)->forward);
+    rxDfaFree(&(*re)->reverse);
+    rxDfaFree(&(*re)->anchored);
+    free((*re)->nodes);
+    free((*re)->sets);
+    free((*re)->nfa);
+    free((*re)->stack);
+    free((*re)->found);
+    free((*re)->mark);
+    free(*re);
+    *re = NULL;
+}
+
+/*
+ * Returns the length of the longest match that starts at position at, or -1 if there is none
+ */
+int regexpMatchAt(regexp *re, const char *string, int len, int at)
+{
+    rxDfa_s *dfa = &re->anchored;
+    int id = rxDfaStart(re, dfa, at == 0);
+    int best = dfa->states[id].accept ? 0 : -1;
+
+    int i;
+    for (i = at; i < len; i++)
+    {
+        id = rxDfaStep(re, dfa, id, (unsigned char) string[i]);
+        // nothing can match anymore
+        if (dfa->states[id].setLen == 0) return best;
+        if (dfa->states[id].accept) best = i + 1 - at;
+    }
+
+    id = rxDfaStep(re, dfa, id, RX_EOL);
+    if (dfa->states[id].accept) best = len - at;
+
+    return best;
+}
+
+/*
+ * Finds the leftmost match that starts at or after from, and returns its start and end
+ */
+bool regexpFind(regexp *re, const char *string, int len, int from, int *start, int *end)
+{
+    if (from > len) return false;
+
+    // forward pass, to see if there is a match at all
+    rxDfa_s *dfa = &re->forward;
+    int id = rxDfaStart(re, dfa, false);
+    bool found = dfa->states[id].accept;
+    if (!found && from == 0)
+    {
+        id = rxDfaStep(re, dfa, id, RX_BOL);
+        found = dfa->states[id].accept;
+    }
+
+    for (int i = from; i < len && !found; i++)
+    {
+        id = rxDfaStep(re, dfa, id, (unsigned char) string[i]);
+        found = dfa->states[id].accept;
+    }
+
+    if (!found)
+    {
+        id = rxDfaStep(re, dfa, id, RX_EOL);
+        found = dfa->states[id].accept;
+    }
+
+    if (!found) return false;
+
+    // backward pass with the reversed pattern, from the end of the line. Every accepting state
+    // marks a position where a match starts, the last one seen is the leftmost.
+    dfa = &re->reverse;
+    int best = -1;
+    id = rxDfaStart(re, dfa, false);
+    if (dfa->states[id].accept) best = len;
+
+    id = rxDfaStep(re, dfa, id, RX_EOL);
+    if (dfa->states[id].accept) best = len;
+
+    for (int i = len - 1; i >= from; i--)
+    {
+        id = rxDfaStep(re, dfa, id, (unsigned char) string[i]);
+        if (dfa->states[id].accept) best = i;
+    }
+
+    if (from == 0)
+    {
+        id = rxDfaStep(re, dfa, id, RX_BOL);
+        if (dfa->states[id].accept) best = 0;
+    }
+
+    if (best == -1) return false;
+
+    *start = best;
+    *end = best + regexpMatchAt(re, string, len, best);
+
+    return true;
+}
+
+/*
+ * Finds the rightmost match that starts before position before, and returns its start and end
+ */
+bool regexpFindLast(regexp *re, const char *string, int len, int before, int *start, int *end)
+{
+    rxDfa_s *dfa = &re->reverse;
+    int best = -1;
+
+    int id = rxDfaStart(re, dfa, false);
+    if (dfa->states[id].accept && len < before) best = len;
+
+    if (best == -1)
+    {
+        id = rxDfaStep(re, dfa, id, RX_EOL);
+        if (dfa->states[id].accept && len < before) best = len;
+    }
+
+    for (int i = len - 1; i >= 0 && best == -1; i--)
+    {
+        id = rxDfaStep(re, dfa, id, (unsigned char) string[i]);
+        if (dfa->states[id].accept && i < before) best = i;
+    }
+
+    if (best == -1 && before > 0)
+    {
+        id = rxDfaStep(re, dfa, id, RX_BOL);
+        if (dfa->states[id].accept) best = 0;
+    }
+
+    if (best == -1) return false;
+
+    *start = best;
+    *end = best + regexpMatchAt(re, string, len, best);
+
+    return true;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdbool.h>
+
+typedef struct regexp_s regexp;
+
+regexp *regexpCompile(const char *pattern, const char **error);
+void regexpFree(regexp **re);
+bool regexpFind(regexp *re, const char *string, int len, int from, int *start, int *end);
+bool regexpFindLast(regexp *re, const char *string, int len, int before, int *start, int *end);
+int regexpMatchAt(regexp *re, const char *string, int len, int at);
@@ -0,0 +1,603 @@
+#include "render.h"
+#include "syntax.h"
+#include "terminal.h"
+#include "utf8.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#define RENDER_CACHE_MIN        64      // renders kept, whatever the size of the screen
+#define RENDER_CACHE_SCREENS    4       // renders kept per row of the screen
+
+/*
+ * Turns the text of a row into what is drawn: tabs are expanded to the next tab stop, invalid
+ * UTF-8 is replaced and every byte gets its highlight color. A position in a row has three
+ * coordinates: cx in the row string, rx the screen column and rb in the render string.
+ *
+ * Plain ASCII advances all three by one per byte. Every other character is a glyph, and a
+ * render keeps the table of its glyphs, so the coordinates map to each other with a binary
+ * search instead of a scan of the row. Rows of plain ASCII have no table at all.
+ *
+ * An edit only renders the text from the edit up to the first tab after it. The tab ends on a tab
+ * stop, so the render of the rest of the row stays the same and is only moved.
+ *
+ * Only the renders of the rows used last are kept, in a cache a few screens large. A row holds
+ * the slot of its render and the stamp the slot was given when the row was rendered into it. A
+ * slot gets a new stamp when another row takes it, so a row whose stamp no longer matches is
+ * rendered again the next time it is needed. Rows move around in the document, which is why the
+ * cache never points back at them.
+ */
+
+/*
+ * A character that is not one byte wide and one column on screen: a tab or a UTF-8 sequence.
+ * The render positions are those right after it.
+ */
+typedef struct
+{
+    int cx;             // index of the character in the row string
+    int cxEnd;          // index after it
+    int rx;             // column after it
+    int rb;             // offset in the render string after it
+} renderGlyph_s;
+
+typedef struct
+{
+    int count;
+    renderGlyph_s at[];
+} renderGlyphs_s;
+
+typedef struct
+{
+    char *string;               // NULL-terminated
+    int size;                   // in bytes, not columns
+    int capacity;               // of both string and hl
+    unsigned char *hl;          // termColor_e of every byte in string
+    renderGlyphs_s *glyphs;     // NULL if the row has none
+    uint64_t stamp;             // of the row rendered here, 0 if there is none
+    int prev;                   // from the most to the least recently used, -1 at the ends
+    int next;
+} renderLine_s;
+
+typedef struct
+{
+    int cx;
+    int rx;
+    int rb;
+} renderPos_s;
+
+static struct
+{
+    renderLine_s *lines;
+    int count;
+    int head;           // the most recently used
+    int tail;
+    uint64_t stamp;     // the last one given out
+} renderCache;
+
+
+static inline int renderTabWidth(int rx)
+{
+    return RENDER_TAB_STOP - (rx % RENDER_TAB_STOP);
+}
+
+/*
+ * Length of the run at the start of s of characters that are one byte and one column: ASCII
+ * except tabs. Checks eight bytes at a time.
+ */
+static int renderPlainSpan(const char *s, int len)
+{
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t highs = 0x8080808080808080ull;
+
+    int i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, &s[i], sizeof(word));
+        // a tab turns into a zero byte, which borrows when ones are subtracted
+        uint64_t tabs = word ^ (ones * '\t');
+        if ((((tabs - ones) & ~tabs) | word) & highs) break;
+    }
+
+    while (i < len && (unsigned char)s[i] < 0x80 && s[i] != '\t') i++;
+    return i;
+}
+
+/*
+ * Measures the glyph at string[i]. Sets the columns and render bytes it takes, and returns its
+ * length in the string.
+ */
+static int renderMeasureGlyph(edRow_s *row, int i, int rx, int *width, int *bytes)
+{
+    if (row->string[i] == '\t')
+    {
+        *width = renderTabWidth(rx);
+        *bytes = *width;
+        return 1;
+    }
+
+    uint32_t cp;
+    int len = utf8Decode(&row->string[i], row->size - i, &cp);
+    // C1 control codes would be run by the terminal
+    if (cp == UTF8_INVALID || (cp >= 0x80 && cp < 0xA0))
+    {
+        *width = 1;
+        *bytes = UTF8_REPLACEMENT_LEN;
+        return len;
+    }
+
+    *width = utf8Width(cp);
+    *bytes = len;
+    return len;
+}
+
+/*
+ * Measures string[pos.cx, to) without rendering it, and counts its glyphs. A glyph that starts
+ * before to is measured whole.
+ */
+static renderPos_s renderMeasure(edRow_s *row, renderPos_s pos, int to, int *numGlyphs)
+{
+    while (pos.cx < to)
+    {
+        int plain = renderPlainSpan(&row->string[pos.cx], to - pos.cx);
+        pos.cx += plain;
+        pos.rx += plain;
+        pos.rb += plain;
+        if (pos.cx >= to) break;
+
+        int width, bytes;
+        pos.cx += renderMeasureGlyph(row, pos.cx, pos.rx, &width, &bytes);
+        pos.rx += width;
+        pos.rb += bytes;
+        (*numGlyphs)++;
+    }
+
+    return pos;
+}
+
+/*
+ * Renders string[pos.cx, to) at pos, and records its glyphs starting at glyphs->at[glyph]
+ */
+static void renderText(edRow_s *row, renderLine_s *r, renderPos_s pos, int to, int glyph)
+{
+    while (pos.cx < to)
+    {
+        int plain = renderPlainSpan(&row->string[pos.cx], to - pos.cx);
+        memcpy(&r->string[pos.rb], &row->string[pos.cx], plain);
+        pos.cx += plain;
+        pos.rx += plain;
+        pos.rb += plain;
+        if (pos.cx >= to) break;
+
+        int width, bytes;
+        int len = renderMeasureGlyph(row, pos.cx, pos.rx, &width, &bytes);
+        char *out = &r->string[pos.rb];
+        if (row->string[pos.cx] == '\t') memset(out, ' ', bytes);
+        else if (bytes != len) memcpy(out, UTF8_REPLACEMENT, UTF8_REPLACEMENT_LEN);
+        else memcpy(out, &row->string[pos.cx], len);
+
+        renderGlyph_s *g = &r->glyphs->at[glyph++];
+        g->cx = pos.cx;
+        pos.cx += len;
+        pos.rx += width;
+        pos.rb += bytes;
+        g->cxEnd = pos.cx;
+        g->rx = pos.rx;
+        g->rb = pos.rb;
+    }
+}
+
+static void renderReserve(renderLine_s *r, int size)
+{
+    if (size + 1 <= r->capacity) return;
+
+    int capacity = r->capacity ? r->capacity : 16;
+    while (capacity < size + 1) capacity *= 2;
+    r->string = realloc(r->string, capacity);
+    r->hl = realloc(r->hl, capacity);
+    assert(r->string != NULL && r->hl != NULL);
+    r->capacity = capacity;
+}
+
+static void renderResizeGlyphs(renderLine_s *r, int count)
+{
+    if (count == 0)
+    {
+        free(r->glyphs);
+        r->glyphs = NULL;
+        return;
+    }
+
+    r->glyphs = realloc(r->glyphs, sizeof(renderGlyphs_s) + sizeof(renderGlyph_s) * count);
+    assert(r->glyphs != NULL);
+    r->glyphs->count = count;
+}
+
+static inline int renderNumGlyphs(renderLine_s *r)
+{
+    return r->glyphs ? r->glyphs->count : 0;
+}
+
+/*
+ * Position right after glyph i, or the start of the row for -1
+ */
+static inline renderPos_s renderAfterGlyph(renderLine_s *r, int i)
+{
+    if (i < 0) return (renderPos_s){ 0, 0, 0 };
+
+    renderGlyph_s *g = &r->glyphs->at[i];
+    return (renderPos_s){ g->cxEnd, g->rx, g->rb };
+}
+
+/*
+ * Index of the first glyph that ends after cx
+ */
+static int renderFirstGlyph(renderLine_s *r, int cx)
+{
+    int lo = 0;
+    int hi = renderNumGlyphs(r);
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (r->glyphs->at[mid].cxEnd <= cx) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return lo;
+}
+
+/*
+ * Position of the character at cx. A position inside a glyph moves to its start.
+ */
+static renderPos_s renderPosAt(renderLine_s *r, int cx)
+{
+    int i = renderFirstGlyph(r, cx);
+    if (i < renderNumGlyphs(r) && r->glyphs->at[i].cx < cx) cx = r->glyphs->at[i].cx;
+
+    renderPos_s pos = renderAfterGlyph(r, i - 1);
+    int plain = cx - pos.cx;
+    return (renderPos_s){ cx, pos.rx + plain, pos.rb + plain };
+}
+
+/*
+ * Position of the character shown at column rx. A column inside a glyph gives its start, and
+ * zero width glyphs belong to the character before them. Columns past the end of the row are
+ * not clamped.
+ */
+static renderPos_s renderPosAtColumn(renderLine_s *r, int rx)
+{
+    // glyphs [0, i) end at or before rx
+    int lo = 0;
+    int hi = renderNumGlyphs(r);
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (r->glyphs->at[mid].rx <= rx) lo = mid + 1;
+        else hi = mid;
+    }
+
+    int i = lo;
+    renderPos_s pos = renderAfterGlyph(r, i - 1);
+    int plain = rx - pos.rx;
+    if (i < renderNumGlyphs(r) && pos.cx + plain > r->glyphs->at[i].cx) plain = r->glyphs->at[i].cx - pos.cx;
+
+    return (renderPos_s){ pos.cx + plain, pos.rx + plain, pos.rb + plain };
+}
+
+/*
+ * Number of columns of the rendered row
+ */
+static int renderColumns(edRow_s *row, renderLine_s *r)
+{
+    renderPos_s pos = renderAfterGlyph(r, renderNumGlyphs(r) - 1);
+    return pos.rx + (row->size - pos.cx);
+}
+
+static void renderUnlink(int i)
+{
+    renderLine_s *r = &renderCache.lines[i];
+    if (r->prev >= 0) renderCache.lines[r->prev].next = r->next;
+    else renderCache.head = r->next;
+    if (r->next >= 0) renderCache.lines[r->next].prev = r->prev;
+    else renderCache.tail = r->prev;
+}
+
+static void renderPushFront(int i)
+{
+    renderLine_s *r = &renderCache.lines[i];
+    r->prev = -1;
+    r->next = renderCache.head;
+    if (renderCache.head >= 0) renderCache.lines[renderCache.head].prev = i;
+    else renderCache.tail = i;
+    renderCache.head = i;
+}
+
+/*
+ * Drops every render, and makes room for count of them
+ */
+static void renderCacheReset(int count)
+{
+    for (int i = 0; i < renderCache.count; i++)
+    {
+        free(renderCache.lines[i].string);
+        free(renderCache.lines[i].hl);
+        free(renderCache.lines[i].glyphs);
+    }
+
+    renderCache.lines = realloc(renderCache.lines, sizeof(renderLine_s) * count);
+    assert(renderCache.lines != NULL);
+    memset(renderCache.lines, 0, sizeof(renderLine_s) * count);
+    renderCache.count = count;
+    renderCache.head = -1;
+    renderCache.tail = -1;
+    for (int i = 0; i < count; i++) renderPushFront(i);
+}
+
+/*
+ * The render of a row if it is still cached, which makes it the most recently used
+ */
+static renderLine_s *renderLookup(edRow_s *row)
+{
+    if (row->renderStamp == 0 || row->renderSlot >= renderCache.count) return NULL;
+
+    renderLine_s *r = &renderCache.lines[row->renderSlot];
+    if (r->stamp != row->renderStamp) return NULL;
+
+    if (renderCache.head != row->renderSlot)
+    {
+        renderUnlink(row->renderSlot);
+        renderPushFront(row->renderSlot);
+    }
+
+    return r;
+}
+
+/*
+ * Renders the whole row into the least recently used slot
+ */
+static renderLine_s *renderInto(edRow_s *row)
+{
+    if (renderCache.count == 0) renderCacheReset(RENDER_CACHE_MIN);
+
+    int slot = renderCache.tail;
+    renderUnlink(slot);
+    renderPushFront(slot);
+
+    renderLine_s *r = &renderCache.lines[slot];
+    r->stamp = ++renderCache.stamp;
+    row->renderSlot = slot;
+    row->renderStamp = r->stamp;
+
+    int numGlyphs = 0;
+    renderPos_s end = renderMeasure(row, (renderPos_s){ 0, 0, 0 }, row->size, &numGlyphs);
+
+    renderResizeGlyphs(r, numGlyphs);
+    renderReserve(r, end.rb);
+    renderText(row, r, (renderPos_s){ 0, 0, 0 }, row->size, 0);
+    r->size = end.rb;
+    r->string[r->size] = '\0';
+
+    synHighlight(r->string, r->size, r->hl);
+    return r;
+}
+
+static inline renderLine_s *renderGet(edRow_s *row)
+{
+    renderLine_s *r = renderLookup(row);
+    return r ? r : renderInto(row);
+}
+
+/*
+ * Sizes the render cache for a screen with rows of text. The renders are dropped, and made
+ * again as the rows are drawn.
+ */
+void renderCacheResize(int rows)
+{
+    int count = rows * RENDER_CACHE_SCREENS;
+    renderCacheReset((count > RENDER_CACHE_MIN) ? count : RENDER_CACHE_MIN);
+}
+
+/*
+ * Renders the whole row
+ */
+void renderRow(edRow_s *row)
+{
+    renderInto(row);
+}
+
+/*
+ * Updates the render after string[at, at + removed) was replaced by string[at, at + inserted).
+ * A row that has no render stays that way until it is drawn.
+ */
+void renderRowEdit(edRow_s *row, int at, int removed, int inserted)
+{
+    renderLine_s *r = renderLookup(row);
+    if (!r) return;
+
+    int numGlyphs = renderNumGlyphs(r);
+    int delta = inserted - removed;
+
+    // a UTF-8 sequence that starts up to 3 bytes before the edit may decode differently now
+    renderPos_s start = renderPosAt(r, at > 3 ? at - 3 : 0);
+    int first = renderFirstGlyph(r, start.cx);
+
+    // render until the new text is back in step with the old one, which is at the first old
+    // character boundary after the edit, and past the first tab if the columns moved off the tab stops
+    renderPos_s end = start;
+    renderPos_s oldEnd;
+    int added = 0;
+    int to = at + inserted;
+    int last;
+    while (1)
+    {
+        end = renderMeasure(row, end, to, &added);
+
+        int oldCx = end.cx - delta;
+        last = renderFirstGlyph(r, oldCx);
+        if (last < numGlyphs && r->glyphs->at[last].cx < oldCx)
+        {
+            // in the middle of an old glyph
+            to = r->glyphs->at[last].cxEnd + delta;
+            continue;
+        }
+
+        oldEnd = renderPosAt(r, oldCx);
+        if ((end.rx - oldEnd.rx) % RENDER_TAB_STOP == 0) break;
+
+        int tab = last;
+        while (tab < numGlyphs && row->string[r->glyphs->at[tab].cx + delta] != '\t') tab++;
+        if (tab == numGlyphs) break;
+        to = r->glyphs->at[tab].cxEnd + delta;
+    }
+
+    int rxShift = end.rx - oldEnd.rx;
+    int rbShift = end.rb - oldEnd.rb;
+    int oldSize = r->size;
+
+    // make room in the glyph table, and move the glyphs after the edit
+    int newNumGlyphs = numGlyphs - (last - first) + added;
+    if (newNumGlyphs > numGlyphs) renderResizeGlyphs(r, newNumGlyphs);
+    if (last < numGlyphs)
+    {
+        renderGlyph_s *glyphs = r->glyphs->at;
+        memmove(&glyphs[first + added], &glyphs[last], sizeof(renderGlyph_s) * (numGlyphs - last));
+        for (int i = first + added; i < first + added + numGlyphs - last; i++)
+        {
+            glyphs[i].cx += delta;
+            glyphs[i].cxEnd += delta;
+            glyphs[i].rx += rxShift;
+            glyphs[i].rb += rbShift;
+        }
+    }
+    if (newNumGlyphs < numGlyphs) renderResizeGlyphs(r, newNumGlyphs);
+
+    // move the rest of the render, and fill in the edited part
+    renderReserve(r, oldSize + rbShift);
+    memmove(&r->string[end.rb], &r->string[oldEnd.rb], oldSize - oldEnd.rb + 1);
+    memmove(&r->hl[end.rb], &r->hl[oldEnd.rb], oldSize - oldEnd.rb);
+    r->size = oldSize + rbShift;
+    renderText(row, r, start, end.cx, first);
+
+    // a quote or a comment marker changes the colors up to the end of the row
+    synHighlight(r->string, r->size, r->hl);
+}
+
+/*
+ * Screen column of the character at index cx
+ */
+int renderCxToRx(edRow_s *row, int cx)
+{
+    return renderPosAt(renderGet(row), cx).rx;
+}
+
+/*
+ * Index of the character shown at column rx. Columns past the end of the row are not clamped.
+ */
+int renderRxToCx(edRow_s *row, int rx)
+{
+    return renderPosAtColumn(renderGet(row), rx).cx;
+}
+
+/*
+ * Cursor position after the character at cx. Zero width characters, like combining marks, are
+ * skipped along with the character they follow.
+ */
+int renderNextCx(edRow_s *row, int cx)
+{
+    if (cx >= row->size) return row->size;
+    renderLine_s *r = renderGet(row);
+
+    renderPos_s pos = renderPosAt(r, cx);
+    int i = renderFirstGlyph(r, pos.cx);
+    int rx = (i < renderNumGlyphs(r) && r->glyphs->at[i].cx == pos.cx) ? r->glyphs->at[i].rx : pos.rx + 1;
+
+    int next = renderPosAtColumn(r, rx).cx;
+    return (next < row->size) ? next : row->size;
+}
+
+/*
+ * Cursor position of the character before cx
+ */
+int renderPrevCx(edRow_s *row, int cx)
+{
+    renderLine_s *r = renderGet(row);
+
+    renderPos_s pos = renderPosAt(r, cx);
+    if (pos.rx == 0) return 0;
+    return renderPosAtColumn(r, pos.rx - 1).cx;
+}
+
+/*
+ * Finds the part of the render shown in columns [col, col + cols). Returns its text, sets hl to
+ * its colors and len to its length in bytes. A wide character cut in half at col is left out,
+ * and pad is set to the number of blank columns it leaves. Both stay valid until the cache has
+ * rendered as many other rows as it holds.
+ */
+const char *renderSlice(edRow_s *row, int col, int cols, int *len, int *pad, const unsigned char **hl)
+{
+    renderLine_s *r = renderGet(row);
+
+    *len = 0;
+    *pad = 0;
+    *hl = &r->hl[r->size];
+    int columns = renderColumns(row, r);
+    if (col >= columns) return &r->string[r->size];
+
+    renderPos_s start = renderPosAtColumn(r, col);
+    if (start.rx < col)
+    {
+        int i = renderFirstGlyph(r, start.cx);
+        renderPos_s after = renderAfterGlyph(r, i);
+        if (row->string[start.cx] == '\t')
+        {
+            // a tab is rendered as spaces, which can be cut anywhere
+            start.rb += col - start.rx;
+            start.rx = col;
+        }
+        else
+        {
+            *pad = after.rx - col;
+            start = after;
+        }
+    }
+
+    int end = (cols >= columns - col) ? r->size : renderPosAtColumn(r, col + cols).rb;
+    if (end > start.rb) *len = end - start.rb;
+    *hl = &r->hl[start.rb];
+    return &r->string[start.rb];
+}
+
+/*
+ * Draws the part of the row shown in columns [col, col + cols) into line. The runs of equally
+ * colored characters are walked, and only the changes of color are drawn: the screen sends
+ * them when they are needed.
+ */
+void renderDraw(edRow_s *row, int col, int cols, astring *line)
+{
+    int len, pad;
+    const unsigned char *hl;
+    const char *text = renderSlice(row, col, cols, &len, &pad, &hl);
+    // the rest of a wide character that starts left of the window
+    for (int i = 0; i < pad; i++) astringAppend(line, " ", 1);
+
+    termColor_e color = TERM_COLOR_NONE;
+    int start = 0;
+    while (start < len)
+    {
+        int end = start + 1;
+        while (end < len && hl[end] == hl[start]) end++;
+
+        if (hl[start] != color)
+        {
+            color = hl[start];
+            const char *colorStr = (color != TERM_COLOR_NONE) ? termGetColor(color) : FG_COLOR_RESET;
+            astringAppend(line, colorStr, strlen(colorStr));
+        }
+        astringAppend(line, &text[start], end - start);
+
+        start = end;
+    }
+    if (color != TERM_COLOR_NONE) astringAppend(line, FG_COLOR_RESET, FG_COLOR_RESET_SIZE);
+}
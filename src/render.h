@@ -0,0 +1,16 @@
+#pragma once
+
+#include "document.h"
+#include "astring.h"
+
+#define RENDER_TAB_STOP 8
+
+void renderCacheResize(int rows);
+void renderRow(edRow_s *row);
+void renderRowEdit(edRow_s *row, int at, int removed, int inserted);
+int renderCxToRx(edRow_s *row, int cx);
+int renderRxToCx(edRow_s *row, int rx);
+int renderNextCx(edRow_s *row, int cx);
+int renderPrevCx(edRow_s *row, int cx);
+const char *renderSlice(edRow_s *row, int col, int cols, int *len, int *pad, const unsigned char **hl);
+void renderDraw(edRow_s *row, int col, int cols, astring *line);
@@ -0,0 +1,241 @@
+#define _DEFAULT_SOURCE
+
+#include "replay.h"
+#include "alloccount.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <assert.h>
+
+/*
+ * Key scripts for headless mode, and the statistics of replaying them.
+ *
+ * A script has one entry per line: a repeat count, a space, and the keys to send that many times.
+ * The keys are the bytes a terminal would send, with the escapes \e (ESC), \r (Enter), \t, \\
+ * and \xNN. Empty lines and lines starting with # are ignored. For example:
+ *
+ *     # page through the file, then search for "main"
+ *     100 \e[6~
+ *     1 \x06main\r
+ */
+
+typedef struct
+{
+    double seconds;
+    size_t bytes;
+    size_t allocs;
+} replaySample_s;
+
+struct replay_s
+{
+    char *keys;
+    size_t keysLen;
+
+    replaySample_s *samples;
+    int numSamples;
+    int capacity;
+
+    // the key being measured
+    double start;
+    size_t startBytes;
+    size_t startAllocs;
+};
+
+
+static double replayNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void replayAppend(replay *r, const char *keys, size_t len, size_t *capacity)
+{
+    if (r->keysLen + len > *capacity)
+    {
+        *capacity = (r->keysLen + len) * 2;
+        r->keys = realloc(r->keys, *capacity);
+        assert(r->keys != NULL);
+    }
+
+    memcpy(&r->keys[r->keysLen], keys, len);
+    r->keysLen += len;
+}
+
+/*
+ * Decodes the escapes in the keys of one script line. Returns the number of bytes, or -1.
+ */
+static int replayDecode(const char *src, char *dst)
+{
+    int len = 0;
+    while (*src)
+    {
+        if (*src != '\\')
+        {
+            dst[len++] = *src++;
+            continue;
+        }
+
+        src++;
+        switch (*src)
+        {
+            case 'e': dst[len++] = '\x1b'; break;
+            case 'r': dst[len++] = '\r'; break;
+            case 't': dst[len++] = '\t'; break;
+            case '\\': dst[len++] = '\\'; break;
+            case 'x':
+                {
+                    if (!isxdigit((unsigned char) src[1]) || !isxdigit((unsigned char) src[2])) return -1;
+                    char hex[3] = { src[1], src[2], '\0' };
+                    dst[len++] = strtol(hex, NULL, 16);
+                    src += 2;
+                }
+                break;
+            default:
+                return -1;
+        }
+        src++;
+    }
+
+    return len;
+}
+
+/*
+ * Reads a key script. Prints the problem and returns NULL if it can not be read.
+ */
+replay *replayNew(const char *filename)
+{
+    FILE *fp = fopen(filename, "r");
+    if (!fp)
+    {
+        perror(filename);
+        return NULL;
+    }
+
+    replay *r = calloc(1, sizeof(*r));
+    assert(r != NULL);
+    size_t capacity = 0;
+
+    char *line = NULL;
+    size_t lineSize = 0;
+    ssize_t lineLen;
+    int lineNum = 0;
+    while ((lineLen = getline(&line, &lineSize, fp)) != -1)
+    {
+        lineNum++;
+        while (lineLen > 0 && (line[lineLen - 1] == '\n' || line[lineLen - 1] == '\r')) line[--lineLen] = '\0';
+        if (lineLen == 0 || line[0] == '#') continue;
+
+        char *keys;
+        long count = strtol(line, &keys, 10);
+        char *decoded = malloc(lineLen + 1);
+        assert(decoded != NULL);
+        int keysLen = (keys != line && *keys == ' ' && count > 0) ? replayDecode(keys + 1, decoded) : -1;
+        if (keysLen <= 0)
+        {
+            fprintf(stderr, "%s:%d: expected a count and keys\n", filename, lineNum);
+            free(decoded);
+            free(line);
+            fclose(fp);
+            replayFree(&r);
+            return NULL;
+        }
+
+        for (long i = 0; i < count; i++) replayAppend(r, decoded, keysLen, &capacity);
+        free(decoded);
+    }
+
+    free(line);
+    fclose(fp);
+
+    return r;
+}
+
+void replayFree(replay **r)
+{
+    if (*r == NULL) return;
+    free((*r)->keys);
+    free((*r)->samples);
+    free(*r);
+    *r = NULL;
+}
+
+/*
+ * All the keys of the script, as a terminal would send them
+ */
+const char *replayKeys(replay *r, size_t *len)
+{
+    *len = r->keysLen;
+    return r->keys;
+}
+
+/*
+ * Starts measuring the handling of one key, up to and including the frame it produces
+ */
+void replayStartKey(replay *r, size_t bytesWritten)
+{
+    r->startBytes = bytesWritten;
+    r->startAllocs = allocCount();
+    r->start = replayNow();
+}
+
+void replayEndKey(replay *r, size_t bytesWritten)
+{
+    double end = replayNow();
+
+    if (r->numSamples == r->capacity)
+    {
+        r->capacity = r->capacity ? r->capacity * 2 : 1024;
+        r->samples = realloc(r->samples, sizeof(*r->samples) * r->capacity);
+        assert(r->samples != NULL);
+    }
+
+    replaySample_s *sample = &r->samples[r->numSamples++];
+    sample->seconds = end - r->start;
+    sample->bytes = bytesWritten - r->startBytes;
+    sample->allocs = allocCount() - r->startAllocs;
+}
+
+static int replayCompare(const void *a, const void *b)
+{
+    double x = ((const replaySample_s *) a)->seconds;
+    double y = ((const replaySample_s *) b)->seconds;
+    return (x > y) - (x < y);
+}
+
+static double replayPercentile(replay *r, int percent)
+{
+    int idx = (int) ((long) r->numSamples * percent / 100);
+    if (idx >= r->numSamples) idx = r->numSamples - 1;
+    return r->samples[idx].seconds;
+}
+
+void replayReport(replay *r, FILE *out)
+{
+    if (r->numSamples == 0)
+    {
+        fprintf(out, "no keys replayed\n");
+        return;
+    }
+
+    size_t bytes = 0;
+    size_t allocs = 0;
+    double total = 0;
+    for (int i = 0; i < r->numSamples; i++)
+    {
+        bytes += r->samples[i].bytes;
+        allocs += r->samples[i].allocs;
+        total += r->samples[i].seconds;
+    }
+
+    qsort(r->samples, r->numSamples, sizeof(*r->samples), replayCompare);
+
+    fprintf(out, "keys:         %d in %.3f s\n", r->numSamples, total);
+    fprintf(out, "latency:      p50 %.1f us, p99 %.1f us, max %.1f us\n",
+            replayPercentile(r, 50) * 1e6, replayPercentile(r, 99) * 1e6, r->samples[r->numSamples - 1].seconds * 1e6);
+    fprintf(out, "frame bytes:  %.1f per frame, %zu total\n", (double) bytes / r->numSamples, bytes);
+    if (allocCountEnabled()) fprintf(out, "allocations:  %.1f per frame, %zu total\n", (double) allocs / r->numSamples, allocs);
+    else fprintf(out, "allocations:  not counted, build with NED_COUNT_ALLOCS\n");
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+typedef struct replay_s replay;
+
+replay *replayNew(const char *filename);
+void replayFree(replay **r);
+const char *replayKeys(replay *r, size_t *len);
+void replayStartKey(replay *r, size_t bytesWritten);
+void replayEndKey(replay *r, size_t bytesWritten);
+void replayReport(replay *r, FILE *out);
@@ -0,0 +1,92 @@
+#include "savejob.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Saves a snapshot of the document on a worker thread, so the editor keeps running while the
+ * file is written and synced to disk. The document can be edited while the job runs, but it
+ * must not be freed before the job is finished.
+ */
+struct saveJob_s
+{
+    docSnapshot *snap;
+    char *filename;
+    pthread_t thread;
+    atomic_bool done;
+    void (*notify)(void);   // called from the worker when the save is done
+    int error;          // errno of a failed save, 0 on success
+};
+
+
+static void *saveJobWorker(void *arg)
+{
+    saveJob *job = arg;
+
+    job->error = (docSnapshotSave(job->snap, job->filename) == -1) ? errno : 0;
+    atomic_store(&job->done, true);
+    if (job->notify) job->notify();
+
+    return NULL;
+}
+
+/*
+ * Takes a snapshot of the document and starts saving it. notify, if not NULL, is called from the
+ * worker thread once the save is done. Returns NULL if the thread can not be started.
+ */
+saveJob *saveJobStart(document *doc, const char *filename, void (*notify)(void))
+{
+    saveJob *job = malloc(sizeof(*job));
+    assert(job != NULL);
+    job->snap = docSnapshotNew(doc);
+    job->filename = strdup(filename);
+    assert(job->filename != NULL);
+    job->error = 0;
+    job->notify = notify;
+    atomic_init(&job->done, false);
+
+    if (pthread_create(&job->thread, NULL, saveJobWorker, job) != 0)
+    {
+        docSnapshotFree(&job->snap);
+        free(job->filename);
+        free(job);
+        return NULL;
+    }
+
+    return job;
+}
+
+bool saveJobDone(saveJob *job)
+{
+    return atomic_load(&job->done);
+}
+
+/*
+ * Percentage of the file written so far
+ */
+int saveJobProgress(saveJob *job)
+{
+    size_t size = docSnapshotSize(job->snap);
+    if (size == 0) return 100;
+    return docSnapshotWritten(job->snap) * 100 / size;
+}
+
+/*
+ * Waits for the save to complete and frees the job. Returns 0 on success, or the errno of the failure.
+ */
+int saveJobFinish(saveJob **job)
+{
+    pthread_join((*job)->thread, NULL);
+    int error = (*job)->error;
+
+    docSnapshotFree(&(*job)->snap);
+    free((*job)->filename);
+    free(*job);
+    *job = NULL;
+
+    return error;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "document.h"
+
+#include <stdbool.h>
+
+typedef struct saveJob_s saveJob;
+
+saveJob *saveJobStart(document *doc, const char *filename, void (*notify)(void));
+bool saveJobDone(saveJob *job);
+int saveJobProgress(saveJob *job);
+int saveJobFinish(saveJob **job);
@@ -0,0 +1,349 @@
+#include "screen.h"
+#include "terminal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * Keeps a shadow copy of what is currently shown on the terminal. The editor draws every line of
+ * the next frame into the back buffer, and screenRender only sends the lines that differ from what
+ * is already on screen.
+ *
+ * The SGR sequences in the lines are not sent as they are. screenRender keeps track of the
+ * attributes the terminal has, and only sends a sequence where the printed text needs different
+ * ones, so runs of the same color become one run however they were drawn.
+ */
+struct screen_s
+{
+    int rows;
+    int cols;
+    astring **front;    // what the terminal shows
+    astring **back;     // the frame being drawn
+    bool valid;         // false if we don't know what the terminal shows
+    astring *scroll;    // the scrolls to send before the lines of the next frame
+    int scrolled;       // lines moved by them
+};
+
+/*
+ * The SGR attributes text is drawn with. Only those the editor uses are tracked.
+ */
+typedef struct
+{
+    int fg;             // 30-37, or 39 for the default color
+    bool inverse;
+} screenAttr_s;
+
+static const screenAttr_s screenDefaultAttr = { 39, false };
+
+
+screen *screenNew(int rows, int cols)
+{
+    screen *scr = malloc(sizeof(*scr));
+    assert(scr != NULL);
+    scr->rows = rows;
+    scr->cols = cols;
+    scr->front = malloc(sizeof(*scr->front) * rows);
+    scr->back = malloc(sizeof(*scr->back) * rows);
+    assert(scr->front != NULL && scr->back != NULL);
+
+    for (int y = 0; y < rows; y++)
+    {
+        scr->front[y] = astringNew();
+        scr->back[y] = astringNew();
+        astringReserve(scr->front[y], cols);
+        astringReserve(scr->back[y], cols);
+    }
+
+    scr->valid = false;
+    scr->scroll = astringNew();
+    scr->scrolled = 0;
+
+    return scr;
+}
+
+void screenFree(screen **scr)
+{
+    if (*scr == NULL) return;
+
+    for (int y = 0; y < (*scr)->rows; y++)
+    {
+        astringFree(&(*scr)->front[y]);
+        astringFree(&(*scr)->back[y]);
+    }
+
+    astringFree(&(*scr)->scroll);
+    free((*scr)->front);
+    free((*scr)->back);
+    free(*scr);
+    *scr = NULL;
+}
+
+/*
+ * Returns the (empty) line buffer for screen row y, to draw the next frame into.
+ * A line must not contain newlines, and it must end with the default colors.
+ */
+astring *screenLine(screen *scr, int y)
+{
+    assert(y >= 0 && y < scr->rows);
+    astringClear(scr->back[y]);
+    return scr->back[y];
+}
+
+/*
+ * Forces the next render to redraw every line, e.g. when the terminal has been cleared
+ */
+void screenInvalidate(screen *scr)
+{
+    scr->valid = false;
+    astringClear(scr->scroll);
+    scr->scrolled = 0;
+}
+
+/*
+ * Tells the screen that lines [top, bottom) of the next frame show what the last one did, moved
+ * up by delta lines, or down if it is negative. screenRender has the terminal move them within a
+ * scroll region, and then only sends the lines that scrolled in. Scrolling a whole region away
+ * is left to the redraw.
+ */
+void screenScroll(screen *scr, int top, int bottom, int delta)
+{
+    assert(top >= 0 && bottom <= scr->rows && top < bottom);
+    int height = bottom - top;
+    int lines = (delta > 0) ? delta : -delta;
+    if (!scr->valid || delta == 0 || lines >= height) return;
+
+    // the scroll region homes the cursor, which is moved to the margin the lines leave from.
+    // A newline at the bottom margin and a reverse index at the top one move the region by a line.
+    char cmd[32];
+    int cmdLen = snprintf(cmd, sizeof(cmd), "\x1b[%d;%dr\x1b[%dH", top + 1, bottom, (delta > 0) ? bottom : top + 1);
+    astringAppend(scr->scroll, cmd, cmdLen);
+    for (int i = 0; i < lines; i++)
+    {
+        if (delta > 0) astringAppend(scr->scroll, "\n", 1);
+        else astringAppend(scr->scroll, "\x1bM", 2);
+    }
+    astringAppend(scr->scroll, "\x1b[r", 3);
+    scr->scrolled += lines;
+
+    // the front buffer moves along, and the lines that scroll in are blank
+    for (int i = 0; i < lines; i++)
+    {
+        if (delta > 0)
+        {
+            astring *gone = scr->front[top];
+            memmove(&scr->front[top], &scr->front[top + 1], sizeof(*scr->front) * (height - 1));
+            scr->front[bottom - 1] = gone;
+            astringClear(gone);
+        }
+        else
+        {
+            astring *gone = scr->front[bottom - 1];
+            memmove(&scr->front[top + 1], &scr->front[top], sizeof(*scr->front) * (height - 1));
+            scr->front[top] = gone;
+            astringClear(gone);
+        }
+    }
+}
+
+/*
+ * Applies the SGR sequence at the start of s to attr. Returns its length, or 0 if s does not
+ * start with one.
+ */
+static int screenParseSgr(const char *s, int len, screenAttr_s *attr)
+{
+    if (len < 3 || s[0] != '\x1b' || s[1] != '[') return 0;
+
+    int end = 2;
+    while (end < len && ((s[end] >= '0' && s[end] <= '9') || s[end] == ';')) end++;
+    if (end == len || s[end] != 'm') return 0;
+
+    int i = 2;
+    do
+    {
+        // an empty parameter is a 0
+        int param = 0;
+        while (i < end && s[i] != ';') param = param * 10 + (s[i++] - '0');
+        i++;
+
+        if (param == 0) *attr = screenDefaultAttr;
+        else if (param == 7) attr->inverse = true;
+        else if (param == 27) attr->inverse = false;
+        else if ((param >= 30 && param <= 37) || param == 39) attr->fg = param;
+    } while (i < end);
+
+    return end + 1;
+}
+
+/*
+ * Sends the SGR sequence that changes the attributes of the terminal from cur to want
+ */
+static void screenSetAttr(astring *frame, screenAttr_s *cur, screenAttr_s want)
+{
+    if (cur->fg == want.fg && cur->inverse == want.inverse) return;
+
+    char sgr[16];
+    int len;
+    if (want.fg == screenDefaultAttr.fg && want.inverse == screenDefaultAttr.inverse)
+    {
+        len = snprintf(sgr, sizeof(sgr), "\x1b[m");
+    }
+    else
+    {
+        // every parameter ends with a ';', and the last one is turned into the final 'm'
+        len = snprintf(sgr, sizeof(sgr), "\x1b[");
+        if (want.inverse != cur->inverse) len += snprintf(&sgr[len], sizeof(sgr) - len, want.inverse ? "7;" : "27;");
+        if (want.fg != cur->fg) len += snprintf(&sgr[len], sizeof(sgr) - len, "%d;", want.fg);
+        sgr[len - 1] = 'm';
+    }
+
+    astringAppend(frame, sgr, len);
+    *cur = want;
+}
+
+/*
+ * Returns the number of leading bytes that are equal in both lines, and that can be skipped by
+ * moving the cursor past them. Sets cols to the columns they take, and want to the attributes
+ * the line has after them. We only skip plain printable characters and SGR sequences, since
+ * then the columns are known.
+ */
+static int screenSkippable(astring *old, astring *new, int *cols, screenAttr_s *want)
+{
+    const char *o = astringGetString(old);
+    const char *n = astringGetString(new);
+    int len = (astringGetLen(old) < astringGetLen(new)) ? astringGetLen(old) : astringGetLen(new);
+
+    int i = 0;
+    *cols = 0;
+    while (i < len && o[i] == n[i])
+    {
+        screenAttr_s attr = *want;
+        int sgr = screenParseSgr(&n[i], len - i, &attr);
+        if (sgr)
+        {
+            if (memcmp(&o[i], &n[i], sgr) != 0) break;
+            *want = attr;
+            i += sgr;
+        }
+        else if (n[i] >= ' ' && n[i] <= '~')
+        {
+            i++;
+            (*cols)++;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/*
+ * Appends s[0, len) to frame. The SGR sequences in it only set the attributes wanted for the
+ * text after them, which are sent once text is printed with attributes the terminal does not
+ * have yet. A space looks the same in every foreground color, so it never changes it.
+ */
+static void screenEmit(astring *frame, const char *s, int len, screenAttr_s *want, screenAttr_s *cur)
+{
+    int i = 0;
+    while (i < len)
+    {
+        int sgr = screenParseSgr(&s[i], len - i, want);
+        if (sgr)
+        {
+            i += sgr;
+            continue;
+        }
+
+        // any other escape is passed on as is
+        int end = i + 1;
+        while (end < len && s[end] != '\x1b') end++;
+
+        int spaces = 0;
+        if (cur->inverse == want->inverse)
+        {
+            while (i + spaces < end && s[i + spaces] == ' ') spaces++;
+        }
+        astringAppend(frame, &s[i], spaces);
+
+        if (i + spaces < end)
+        {
+            screenSetAttr(frame, cur, *want);
+            astringAppend(frame, &s[i + spaces], end - i - spaces);
+        }
+        i = end;
+    }
+}
+
+/*
+ * Appends the commands needed to bring the terminal up to date with the back buffer to frame,
+ * and returns the number of lines that changed or moved. The attributes of the terminal are tracked
+ * across the lines, and left at the defaults when the frame is done.
+ */
+int screenRender(screen *scr, astring *frame)
+{
+    // the scrolls are sent first, the terminal attributes are still the defaults
+    int changed = scr->scrolled;
+    if (scr->scrolled) astringAppend(frame, astringGetString(scr->scroll), astringGetLen(scr->scroll));
+    astringClear(scr->scroll);
+    scr->scrolled = 0;
+
+    screenAttr_s cur = screenDefaultAttr;
+    int cursorRow = -1;     // where the cursor is left by the last line sent, -1 if unknown
+
+    for (int y = 0; y < scr->rows; y++)
+    {
+        astring *old = scr->front[y];
+        astring *new = scr->back[y];
+
+        int skip = 0;
+        int skipCols = 0;
+        screenAttr_s want = screenDefaultAttr;
+        if (scr->valid)
+        {
+            if (astringGetLen(old) == astringGetLen(new) && (astringGetLen(new) == 0 ||
+                    memcmp(astringGetString(old), astringGetString(new), astringGetLen(new)) == 0))
+            {
+                continue;
+            }
+
+            skip = screenSkippable(old, new, &skipCols, &want);
+        }
+
+        // Terminal is 1-indexed, so we need to add 1 to the positions
+        char cursorPos[32];
+        int cursorPosLen = (skipCols == 0) ? snprintf(cursorPos, sizeof(cursorPos), "\x1b[%dH", y + 1) :
+                snprintf(cursorPos, sizeof(cursorPos), "\x1b[%d;%dH", y + 1, skipCols + 1);
+        if (cursorRow == y - 1 && y > 0 && skipCols + 2 <= cursorPosLen)
+        {
+            // the line right below the last one sent is reached with a newline, which is shorter
+            // than moving the cursor past the equal text. It is never the last line of the screen.
+            astringAppend(frame, "\r\n", 2);
+            skip = 0;
+            want = screenDefaultAttr;
+        }
+        else
+        {
+            astringAppend(frame, cursorPos, cursorPosLen);
+        }
+
+        screenEmit(frame, astringGetString(new) + skip, astringGetLen(new) - skip, &want, &cur);
+        // the erase fills with the background, which inverse video would change on some terminals
+        if (cur.inverse) screenSetAttr(frame, &cur, want);
+        astringAppend(frame, DISPLAY_ERASE_LINE_CMD, DISPLAY_ERASE_LINE_LEN);
+        cursorRow = y;
+
+        // what we just drew is now on screen, and the old line is reused for the next frame
+        scr->front[y] = new;
+        scr->back[y] = old;
+        changed++;
+    }
+
+    screenSetAttr(frame, &cur, screenDefaultAttr);
+    scr->valid = true;
+
+    return changed;
+}
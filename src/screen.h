@@ -0,0 +1,12 @@
+#pragma once
+
+#include "astring.h"
+
+typedef struct screen_s screen;
+
+screen *screenNew(int rows, int cols);
+void screenFree(screen **scr);
+astring *screenLine(screen *scr, int y);
+void screenInvalidate(screen *scr);
+void screenScroll(screen *scr, int top, int bottom, int delta);
+int screenRender(screen *scr, astring *frame);
@@ -0,0 +1,362 @@
+#include "search.h"
+#include "regexp.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <assert.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// upper bound on the bytes scanned in one go, so a match near the start is found quickly
+#define SEARCH_BLOCK_SIZE (256 * 1024)
+
+/*
+ * Case-insensitive substring search. The query is folded to lower case once, and the text is
+ * scanned for positions where both the first and the last byte of the query match (in either
+ * case), 16 positions at a time when SSE2 is available. Only those candidates are compared in full.
+ *
+ * A query that starts with a '/' is a regular expression instead, see regexp.c.
+ */
+struct search_s
+{
+    char *needle;       // folded to lower case
+    size_t len;
+    unsigned char firstLower, firstUpper;
+    unsigned char lastLower, lastUpper;
+
+    bool isRegex;
+    regexp *re;         // NULL if the pattern did not compile
+    const char *error;
+};
+
+static unsigned char searchFold[256];
+
+
+static void searchInitFold()
+{
+    static bool initialized = false;
+    if (initialized) return;
+
+    for (int c = 0; c < 256; c++) searchFold[c] = tolower(c);
+    initialized = true;
+}
+
+search *searchNew(const char *query)
+{
+    searchInitFold();
+
+    search *s = malloc(sizeof(*s));
+    assert(s != NULL);
+    s->len = strlen(query);
+    s->needle = malloc(s->len + 1);
+    assert(s->needle != NULL);
+    for (size_t i = 0; i <= s->len; i++) s->needle[i] = searchFold[(unsigned char) query[i]];
+
+    s->isRegex = searchIsRegex(query);
+    s->re = NULL;
+    s->error = NULL;
+    if (s->isRegex)
+    {
+        // the pattern is everything after the '/'
+        s->len--;
+        if (s->len) s->re = regexpCompile(query + 1, &s->error);
+    }
+    else if (s->len)
+    {
+        s->firstLower = s->needle[0];
+        s->firstUpper = toupper(s->firstLower);
+        s->lastLower = s->needle[s->len - 1];
+        s->lastUpper = toupper(s->lastLower);
+    }
+
+    return s;
+}
+
+/*
+ * Queries starting with a '/' are regular expressions
+ */
+bool searchIsRegex(const char *query)
+{
+    return query[0] == '/';
+}
+
+/*
+ * Returns why the query could not be compiled, or NULL if it is fine
+ */
+const char *searchError(search *s)
+{
+    return s->error;
+}
+
+void searchFree(search **s)
+{
+    if (*s == NULL) return;
+    regexpFree(&(*s)->re);
+    free((*s)->needle);
+    free(*s);
+    *s = NULL;
+}
+
+/*
+ * Compares the middle of a candidate, the first and last bytes are already known to match
+ */
+static inline bool searchVerify(search *s, const char *candidate)
+{
+    for (size_t i = 1; i + 1 < s->len; i++)
+    {
+        if (searchFold[(unsigned char) candidate[i]] != (unsigned char) s->needle[i]) return false;
+    }
+
+    return true;
+}
+
+static const char *searchScalar(search *s, const char *buf, size_t from, size_t len)
+{
+    for (size_t i = from; i + s->len <= len; i++)
+    {
+        unsigned char first = buf[i];
+        unsigned char last = buf[i + s->len - 1];
+        if (first != s->firstLower && first != s->firstUpper) continue;
+        if (last != s->lastLower && last != s->lastUpper) continue;
+        if (searchVerify(s, &buf[i])) return &buf[i];
+    }
+
+    return NULL;
+}
+
+/*
+ * Returns the first match of a plain query in buf, or NULL
+ */
+const char *searchMemory(search *s, const char *buf, size_t len)
+{
+    if (s->len == 0) return buf;
+    if (s->len > len) return NULL;
+
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i firstLower = _mm_set1_epi8(s->firstLower);
+    const __m128i firstUpper = _mm_set1_epi8(s->firstUpper);
+    const __m128i lastLower = _mm_set1_epi8(s->lastLower);
+    const __m128i lastUpper = _mm_set1_epi8(s->lastUpper);
+
+    // every block checks 16 candidate positions, whose last bytes reach len - 1 bytes further
+    for (; i + 16 + s->len - 1 <= len; i += 16)
+    {
+        __m128i first = _mm_loadu_si128((const __m128i *) &buf[i]);
+        __m128i last = _mm_loadu_si128((const __m128i *) &buf[i + s->len - 1]);
+        __m128i eqFirst = _mm_or_si128(_mm_cmpeq_epi8(first, firstLower), _mm_cmpeq_epi8(first, firstUpper));
+        __m128i eqLast = _mm_or_si128(_mm_cmpeq_epi8(last, lastLower), _mm_cmpeq_epi8(last, lastUpper));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(eqFirst, eqLast));
+
+        while (mask)
+        {
+            int bit = __builtin_ctz(mask);
+            if (searchVerify(s, &buf[i + bit])) return &buf[i + bit];
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    return searchScalar(s, buf, i, len);
+}
+
+/*
+ * Unedited rows that follow each other in the file are also next to each other in memory,
+ * separated by the line ending. Those can be searched as one block.
+ */
+static inline bool searchContiguous(edRow_s *prev, edRow_s *next)
+{
+    if (prev->capacity || next->capacity) return false;
+    const char *end = prev->string + prev->size;
+    return next->string > end && next->string - end <= 2;
+}
+
+static bool searchRegexForward(search *s, document *doc, int fromRow, int fromCol, int toRow, searchMatch_s *match)
+{
+    int numRows = (toRow < docNumRows(doc)) ? toRow : docNumRows(doc);
+    int col = fromCol;
+
+    for (int row = fromRow; row < numRows; row++)
+    {
+        edRow_s *r = docGetRow(doc, row);
+        int start, end;
+        if (col <= r->size && regexpFind(s->re, r->string, r->size, col, &start, &end))
+        {
+            match->row = row;
+            match->col = start;
+            match->len = end - start;
+            return true;
+        }
+        col = 0;
+    }
+
+    return false;
+}
+
+static bool searchRegexBackward(search *s, document *doc, int fromRow, int fromCol, searchMatch_s *match)
+{
+    for (int row = fromRow; row >= 0; row--)
+    {
+        edRow_s *r = docGetRow(doc, row);
+        int limit = (row == fromRow) ? fromCol : INT_MAX;
+        int start, end;
+        if (regexpFindLast(s->re, r->string, r->size, limit, &start, &end))
+        {
+            match->row = row;
+            match->col = start;
+            match->len = end - start;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool searchForward(search *s, document *doc, int fromRow, int fromCol, int toRow, searchMatch_s *match)
+{
+    if (s->isRegex) return searchRegexForward(s, doc, fromRow, fromCol, toRow, match);
+
+    int numRows = (toRow < docNumRows(doc)) ? toRow : docNumRows(doc);
+    int row = fromRow;
+    int col = fromCol;
+
+    while (row < numRows)
+    {
+        // collect the longest run of rows that can be scanned in one go
+        int lastRow = row;
+        edRow_s *first = docGetRow(doc, row);
+        edRow_s *last = first;
+        while (lastRow + 1 < numRows && last->string - first->string < SEARCH_BLOCK_SIZE)
+        {
+            edRow_s *next = docGetRow(doc, lastRow + 1);
+            if (!searchContiguous(last, next)) break;
+            last = next;
+            lastRow++;
+        }
+
+        if (col > first->size) col = first->size;
+        const char *start = first->string + col;
+        const char *end = last->string + last->size;
+
+        int matchRow = row;
+        edRow_s *r = first;
+        const char *p = start;
+        while ((p = searchMemory(s, p, end - p)) != NULL)
+        {
+            // find the row the match is in, the rows are sorted by address
+            while (matchRow < lastRow)
+            {
+                edRow_s *next = docGetRow(doc, matchRow + 1);
+                if (p < next->string) break;
+                r = next;
+                matchRow++;
+            }
+
+            // a match that runs into the line ending is not a match within the row
+            if (p + s->len <= r->string + r->size)
+            {
+                match->row = matchRow;
+                match->col = p - r->string;
+                match->len = s->len;
+                return true;
+            }
+
+            p++;
+        }
+
+        row = lastRow + 1;
+        col = 0;
+    }
+
+    return false;
+}
+
+static bool searchBackward(search *s, document *doc, int fromRow, int fromCol, searchMatch_s *match)
+{
+    if (fromRow >= docNumRows(doc))
+    {
+        fromRow = docNumRows(doc) - 1;
+        fromCol = INT_MAX;
+    }
+
+    if (s->isRegex) return searchRegexBackward(s, doc, fromRow, fromCol, match);
+
+    for (int row = fromRow; row >= 0; row--)
+    {
+        edRow_s *r = docGetRow(doc, row);
+        int limit = (row == fromRow) ? fromCol : INT_MAX;
+
+        // the last match in the row that starts before the limit
+        const char *found = NULL;
+        const char *p = r->string;
+        const char *end = r->string + r->size;
+        while ((p = searchMemory(s, p, end - p)) != NULL && p - r->string < limit)
+        {
+            found = p;
+            p++;
+        }
+
+        if (found)
+        {
+            match->row = row;
+            match->col = found - r->string;
+            match->len = s->len;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Finds the next match from (fromRow, fromCol). Searching forwards (dir = 1) the match may start
+ * at fromCol, searching backwards (dir = -1) it must start before fromCol.
+ */
+bool searchFind(search *s, document *doc, int fromRow, int fromCol, int dir, searchMatch_s *match)
+{
+    if (fromRow < 0 || s->len == 0 || (s->isRegex && s->re == NULL)) return false;
+    if (dir > 0) return searchForward(s, doc, fromRow, fromCol, INT_MAX, match);
+    return searchBackward(s, doc, fromRow, fromCol, match);
+}
+
+/*
+ * Like a forward searchFind, but gives up at row toRow. Used to search a large document in slices.
+ */
+bool searchFindInRows(search *s, document *doc, int fromRow, int fromCol, int toRow, searchMatch_s *match)
+{
+    if (fromRow < 0 || s->len == 0 || (s->isRegex && s->re == NULL)) return false;
+    return searchForward(s, doc, fromRow, fromCol, toRow, match);
+}
+
+/*
+ * Checks if the query matches the text at the given position
+ */
+bool searchMatchesAt(search *s, document *doc, int row, int col)
+{
+    if (row < 0 || row >= docNumRows(doc)) return false;
+    edRow_s *r = docGetRow(doc, row);
+    if (s->isRegex) return s->re && col >= 0 && col <= r->size && regexpMatchAt(s->re, r->string, r->size, col) >= 0;
+    if (col < 0 || col + (int) s->len > r->size) return false;
+    return searchMemory(s, &r->string[col], s->len) == &r->string[col];
+}
+
+/*
+ * Finds the first match in line at or after from, for text that is not in a document
+ */
+bool searchLine(search *s, const char *line, int len, int from, int *start, int *end)
+{
+    if (from > len || s->len == 0 || (s->isRegex && s->re == NULL)) return false;
+    if (s->isRegex) return regexpFind(s->re, line, len, from, start, end);
+
+    const char *p = searchMemory(s, &line[from], len - from);
+    if (!p) return false;
+
+    *start = p - line;
+    *end = *start + s->len;
+    return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "document.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct search_s search;
+
+typedef struct
+{
+    int row;
+    int col;
+    int len;
+} searchMatch_s;
+
+search *searchNew(const char *query);
+void searchFree(search **s);
+bool searchIsRegex(const char *query);
+const char *searchError(search *s);
+const char *searchMemory(search *s, const char *buf, size_t len);
+bool searchFind(search *s, document *doc, int fromRow, int fromCol, int dir, searchMatch_s *match);
+bool searchFindInRows(search *s, document *doc, int fromRow, int fromCol, int toRow, searchMatch_s *match);
+bool searchMatchesAt(search *s, document *doc, int row, int col);
+bool searchLine(search *s, const char *line, int len, int from, int *start, int *end);
@@ -0,0 +1,330 @@
+#define _DEFAULT_SOURCE
+
+#include "searchindex.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define SEARCH_INDEX_SLICE_ROWS 4096    // rows searched between checks for a newer query
+#define SEARCH_INDEX_BATCH      256     // matches collected before they are handed to the UI
+
+/*
+ * Builds the sorted list of all matches of the latest query on a worker thread, so the UI never
+ * waits for a search. Every new query bumps the generation, which makes the worker drop what it
+ * is doing and start over. When the new query only extends the previous one, and all matches of
+ * the previous one are known, the worker only re-checks those matches instead of the whole document.
+ * That does not hold for regular expressions, which are always searched from scratch.
+ *
+ * The document must not be modified while the index exists.
+ */
+struct searchIndex_s
+{
+    document *doc;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool quit;
+    void (*notify)(void);       // called from the worker when there are new matches
+
+    atomic_uint generation;     // bumped for every new query
+    char *query;                // the latest query
+
+    // the matches found so far for resultQuery, protected by lock
+    unsigned resultGeneration;
+    char *resultQuery;
+    searchMatch_s *matches;
+    int numMatches;
+    int capacity;
+    bool complete;
+};
+
+
+static inline bool searchIndexCancelled(searchIndex *idx, unsigned gen)
+{
+    return atomic_load_explicit(&idx->generation, memory_order_relaxed) != gen;
+}
+
+static void searchIndexPublish(searchIndex *idx, searchMatch_s *batch, int count)
+{
+    if (count == 0) return;
+
+    pthread_mutex_lock(&idx->lock);
+    if (idx->numMatches + count > idx->capacity)
+    {
+        int newCapacity = idx->capacity ? idx->capacity * 2 : 1024;
+        while (newCapacity < idx->numMatches + count) newCapacity *= 2;
+        idx->matches = realloc(idx->matches, sizeof(*idx->matches) * newCapacity);
+        assert(idx->matches != NULL);
+        idx->capacity = newCapacity;
+    }
+
+    memcpy(&idx->matches[idx->numMatches], batch, sizeof(*batch) * count);
+    idx->numMatches += count;
+    pthread_mutex_unlock(&idx->lock);
+
+    if (idx->notify) idx->notify();
+}
+
+/*
+ * Searches the whole document, in slices so that a newer query is noticed quickly.
+ * Returns false if the search was cancelled.
+ */
+static bool searchIndexScan(searchIndex *idx, unsigned gen, const char *query)
+{
+    search *s = searchNew(query);
+    searchMatch_s batch[SEARCH_INDEX_BATCH];
+    int count = 0;
+    int numRows = docNumRows(idx->doc);
+    bool cancelled = false;
+
+    for (int from = 0; from < numRows && !cancelled; from += SEARCH_INDEX_SLICE_ROWS)
+    {
+        int row = from;
+        int col = 0;
+        searchMatch_s match;
+        while (searchFindInRows(s, idx->doc, row, col, from + SEARCH_INDEX_SLICE_ROWS, &match))
+        {
+            row = match.row;
+            col = match.col + 1;
+
+            // a regex like /x* matches the empty string at every column, which shows nothing.
+            // Only empty rows are kept, so that /^$ finds them.
+            if (match.len == 0 && docGetRow(idx->doc, match.row)->size > 0) continue;
+
+            batch[count++] = match;
+            if (count == SEARCH_INDEX_BATCH)
+            {
+                searchIndexPublish(idx, batch, count);
+                count = 0;
+            }
+        }
+
+        searchIndexPublish(idx, batch, count);
+        count = 0;
+        cancelled = searchIndexCancelled(idx, gen);
+    }
+
+    searchFree(&s);
+    return !cancelled;
+}
+
+/*
+ * Keeps the matches of the previous query that also match the extended query.
+ * Returns false if the search was cancelled.
+ */
+static bool searchIndexNarrow(searchIndex *idx, unsigned gen, const char *query, searchMatch_s *prev, int numPrev)
+{
+    search *s = searchNew(query);
+    searchMatch_s batch[SEARCH_INDEX_BATCH];
+    int count = 0;
+    int len = strlen(query);
+    bool cancelled = false;
+
+    for (int i = 0; i < numPrev && !cancelled; i++)
+    {
+        if (searchMatchesAt(s, idx->doc, prev[i].row, prev[i].col))
+        {
+            batch[count] = prev[i];
+            batch[count].len = len;
+            count++;
+        }
+
+        if (count == SEARCH_INDEX_BATCH || i == numPrev - 1)
+        {
+            searchIndexPublish(idx, batch, count);
+            count = 0;
+            cancelled = searchIndexCancelled(idx, gen);
+        }
+    }
+
+    searchFree(&s);
+    return !cancelled;
+}
+
+static void *searchIndexWorker(void *arg)
+{
+    searchIndex *idx = arg;
+
+    pthread_mutex_lock(&idx->lock);
+    while (!idx->quit)
+    {
+        unsigned gen = atomic_load(&idx->generation);
+        if (gen == idx->resultGeneration)
+        {
+            pthread_cond_wait(&idx->cond, &idx->lock);
+            continue;
+        }
+
+        char *query = strdup(idx->query);
+
+        // an extended query can only match where the shorter one did
+        searchMatch_s *prev = NULL;
+        int numPrev = 0;
+        if (idx->complete && idx->resultQuery && idx->resultQuery[0] && !searchIsRegex(query) &&
+                strncasecmp(query, idx->resultQuery, strlen(idx->resultQuery)) == 0)
+        {
+            prev = idx->matches;
+            numPrev = idx->numMatches;
+            idx->matches = NULL;
+            idx->capacity = 0;
+        }
+
+        free(idx->resultQuery);
+        idx->resultQuery = query;
+        idx->resultGeneration = gen;
+        idx->numMatches = 0;
+        idx->complete = false;
+        pthread_mutex_unlock(&idx->lock);
+
+        bool done = prev ? searchIndexNarrow(idx, gen, query, prev, numPrev) : searchIndexScan(idx, gen, query);
+        free(prev);
+
+        pthread_mutex_lock(&idx->lock);
+        idx->complete = done;
+        if (done && idx->notify) idx->notify();
+    }
+    pthread_mutex_unlock(&idx->lock);
+
+    return NULL;
+}
+
+
+/*
+ * notify, if not NULL, is called from the worker thread whenever matches are added or a search completes
+ */
+searchIndex *searchIndexNew(document *doc, void (*notify)(void))
+{
+    searchIndex *idx = calloc(1, sizeof(*idx));
+    assert(idx != NULL);
+    idx->doc = doc;
+    idx->notify = notify;
+    pthread_mutex_init(&idx->lock, NULL);
+    pthread_cond_init(&idx->cond, NULL);
+    atomic_init(&idx->generation, 0);
+
+    if (pthread_create(&idx->thread, NULL, searchIndexWorker, idx) != 0)
+    {
+        pthread_mutex_destroy(&idx->lock);
+        pthread_cond_destroy(&idx->cond);
+        free(idx);
+        return NULL;
+    }
+
+    return idx;
+}
+
+void searchIndexFree(searchIndex **idx)
+{
+    if (*idx == NULL) return;
+
+    pthread_mutex_lock(&(*idx)->lock);
+    (*idx)->quit = true;
+    // also makes a running search stop early
+    atomic_fetch_add(&(*idx)->generation, 1);
+    pthread_cond_signal(&(*idx)->cond);
+    pthread_mutex_unlock(&(*idx)->lock);
+    pthread_join((*idx)->thread, NULL);
+
+    pthread_mutex_destroy(&(*idx)->lock);
+    pthread_cond_destroy(&(*idx)->cond);
+    free((*idx)->query);
+    free((*idx)->resultQuery);
+    free((*idx)->matches);
+    free(*idx);
+    *idx = NULL;
+}
+
+/*
+ * Starts indexing a new query, unless it is the one we already have
+ */
+void searchIndexSetQuery(searchIndex *idx, const char *query)
+{
+    pthread_mutex_lock(&idx->lock);
+    if (idx->query == NULL || strcmp(idx->query, query) != 0)
+    {
+        free(idx->query);
+        idx->query = strdup(query);
+        atomic_fetch_add(&idx->generation, 1);
+        pthread_cond_signal(&idx->cond);
+    }
+    pthread_mutex_unlock(&idx->lock);
+}
+
+static inline int searchIndexCompare(const searchMatch_s *match, int row, int col)
+{
+    if (match->row != row) return (match->row < row) ? -1 : 1;
+    if (match->col != col) return (match->col < col) ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Index of the first match at or after (row, col). Must be called with the lock held.
+ */
+static int searchIndexLowerBound(searchIndex *idx, int row, int col)
+{
+    int lo = 0;
+    int hi = idx->numMatches;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (searchIndexCompare(&idx->matches[mid], row, col) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return lo;
+}
+
+static inline bool searchIndexCurrent(searchIndex *idx)
+{
+    return idx->resultGeneration == atomic_load(&idx->generation);
+}
+
+/*
+ * Finds the match after (dir = 1) or before (dir = -1) the given position, among the matches
+ * found so far for the latest query.
+ */
+bool searchIndexNext(searchIndex *idx, int row, int col, int dir, searchMatch_s *match)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&idx->lock);
+    if (searchIndexCurrent(idx))
+    {
+        int i = (dir > 0) ? searchIndexLowerBound(idx, row, col + 1) : searchIndexLowerBound(idx, row, col) - 1;
+        if (i >= 0 && i < idx->numMatches)
+        {
+            *match = idx->matches[i];
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&idx->lock);
+
+    return found;
+}
+
+/*
+ * Returns the number of matches found so far for the latest query. pos is set to the 1-based
+ * number of the match at (row, col), or 0 if there is no match there.
+ */
+int searchIndexStatus(searchIndex *idx, int row, int col, int *pos, bool *complete)
+{
+    int count = 0;
+    *pos = 0;
+    *complete = false;
+
+    pthread_mutex_lock(&idx->lock);
+    if (searchIndexCurrent(idx))
+    {
+        count = idx->numMatches;
+        *complete = idx->complete;
+        int i = searchIndexLowerBound(idx, row, col);
+        if (i < idx->numMatches && searchIndexCompare(&idx->matches[i], row, col) == 0) *pos = i + 1;
+    }
+    pthread_mutex_unlock(&idx->lock);
+
+    return count;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "document.h"
+#include "search.h"
+
+#include <stdbool.h>
+
+typedef struct searchIndex_s searchIndex;
+
+searchIndex *searchIndexNew(document *doc, void (*notify)(void));
+void searchIndexFree(searchIndex **idx);
+void searchIndexSetQuery(searchIndex *idx, const char *query);
+bool searchIndexNext(searchIndex *idx, int row, int col, int dir, searchMatch_s *match);
+int searchIndexStatus(searchIndex *idx, int row, int col, int *pos, bool *complete);
@@ -0,0 +1,166 @@
+#include "slab.h"
+
+#include <stdlib.h>
+#include <stdalign.h>
+#include <assert.h>
+#include <pthread.h>
+
+#define SLAB_MIN_SHIFT  4               // 16 byte blocks
+#define SLAB_MAX_SHIFT  12              // 4 KB blocks, larger ones come from malloc
+#define SLAB_CLASSES    (SLAB_MAX_SHIFT - SLAB_MIN_SHIFT + 1)
+#define SLAB_CHUNK_SIZE (64 * 1024)
+
+/*
+ * Hands out blocks with a power of two size, cut from chunks of SLAB_CHUNK_SIZE bytes. A freed
+ * block goes on the free list of its size and is the next one handed out for that size, so text
+ * that grows and shrinks reuses the same few blocks instead of going through malloc. Freeing the
+ * slab frees all its chunks at once, along with the large blocks that came from malloc.
+ *
+ * A block can be released from any thread.
+ */
+
+typedef struct slabChunk_s
+{
+    struct slabChunk_s *next;
+    alignas(16) char data[];
+} slabChunk_s;
+
+// the header of a block too large for the chunks
+typedef struct slabLarge_s
+{
+    struct slabLarge_s *prev;
+    struct slabLarge_s *next;
+    alignas(16) char data[];
+} slabLarge_s;
+
+typedef struct slabFree_s
+{
+    struct slabFree_s *next;
+} slabFree_s;
+
+struct slab_s
+{
+    pthread_mutex_t lock;
+    slabFree_s *freeLists[SLAB_CLASSES];
+    slabChunk_s *chunks;
+    char *unused;           // the part of the newest chunk that was never handed out
+    size_t unusedSize;
+    slabLarge_s *large;
+};
+
+
+slab *slabNew()
+{
+    slab *s = calloc(1, sizeof(*s));
+    assert(s != NULL);
+    pthread_mutex_init(&s->lock, NULL);
+
+    return s;
+}
+
+void slabFree(slab **s)
+{
+    if (*s == NULL) return;
+
+    while ((*s)->chunks)
+    {
+        slabChunk_s *next = (*s)->chunks->next;
+        free((*s)->chunks);
+        (*s)->chunks = next;
+    }
+
+    while ((*s)->large)
+    {
+        slabLarge_s *next = (*s)->large->next;
+        free((*s)->large);
+        (*s)->large = next;
+    }
+
+    pthread_mutex_destroy(&(*s)->lock);
+    free(*s);
+    *s = NULL;
+}
+
+static inline int slabClass(size_t size)
+{
+    int shift = SLAB_MIN_SHIFT;
+    while (((size_t) 1 << shift) < size) shift++;
+    return shift - SLAB_MIN_SHIFT;
+}
+
+/*
+ * Returns a block of at least size bytes, and sets blockSize to its actual size
+ */
+void *slabAlloc(slab *s, size_t size, size_t *blockSize)
+{
+    if (size > ((size_t) 1 << SLAB_MAX_SHIFT))
+    {
+        slabLarge_s *large = malloc(sizeof(*large) + size);
+        assert(large != NULL);
+        *blockSize = size;
+
+        pthread_mutex_lock(&s->lock);
+        large->prev = NULL;
+        large->next = s->large;
+        if (s->large) s->large->prev = large;
+        s->large = large;
+        pthread_mutex_unlock(&s->lock);
+
+        return large->data;
+    }
+
+    int c = slabClass(size);
+    size_t bytes = (size_t) 1 << (c + SLAB_MIN_SHIFT);
+    *blockSize = bytes;
+
+    pthread_mutex_lock(&s->lock);
+    void *block = s->freeLists[c];
+    if (block)
+    {
+        s->freeLists[c] = s->freeLists[c]->next;
+    }
+    else
+    {
+        if (s->unusedSize < bytes)
+        {
+            // what is left of the old chunk is too small, and stays unused
+            slabChunk_s *chunk = malloc(SLAB_CHUNK_SIZE);
+            assert(chunk != NULL);
+            chunk->next = s->chunks;
+            s->chunks = chunk;
+            s->unused = chunk->data;
+            s->unusedSize = SLAB_CHUNK_SIZE - offsetof(slabChunk_s, data);
+        }
+
+        block = s->unused;
+        s->unused += bytes;
+        s->unusedSize -= bytes;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return block;
+}
+
+/*
+ * Gives back a block, with the blockSize slabAlloc set
+ */
+void slabRelease(slab *s, void *block, size_t blockSize)
+{
+    pthread_mutex_lock(&s->lock);
+    if (blockSize > ((size_t) 1 << SLAB_MAX_SHIFT))
+    {
+        slabLarge_s *large = (slabLarge_s *) ((char *) block - offsetof(slabLarge_s, data));
+        if (large->prev) large->prev->next = large->next;
+        else s->large = large->next;
+        if (large->next) large->next->prev = large->prev;
+        free(large);
+    }
+    else
+    {
+        slabFree_s *free = block;
+        int c = slabClass(blockSize);
+        free->next = s->freeLists[c];
+        s->freeLists[c] = free;
+    }
+    pthread_mutex_unlock(&s->lock);
+}
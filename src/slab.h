@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stddef.h>
+
+typedef struct slab_s slab;
+
+slab *slabNew();
+void slabFree(slab **s);
+void *slabAlloc(slab *s, size_t size, size_t *blockSize);
+void slabRelease(slab *s, void *block, size_t blockSize);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "terminal.h"
+
+#include <stdint.h>
+
+struct keyword
+{
+    const char *key;
+    int len;
+    termColor_e color;
+};
+
+/*
+ * Seeded FNV-1a. The keyword table generator (tools/kwgen.c) and the lookup in syntax.c must use
+ * the exact same function, so it lives here.
+ */
+static inline uint32_t synHash(const char *string, int len, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    for (int i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char) string[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
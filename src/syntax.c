@@ -1,29 +1,25 @@
 #include "syntax.h"
 #include "utils.h"
 #include "terminal.h"
+#include "synhash.h"
+#include "keywords.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
+#define SYN_COLOR_COMMENT   TERM_COLOR_BLUE
+#define SYN_COLOR_STRING    TERM_COLOR_MAGENTA
+#define SYN_COLOR_NUMBER    TERM_COLOR_YELLOW     // like the constants in keywords.txt
 
-struct keyword
+/*
+ * The keyword table is a perfect hash generated from keywords.txt at build time, see tools/kwgen.c
+ */
+termColor_e synGetKeyword(const char *tok, int len)
 {
-    char *key;
-    termColor_e color;
-};
-
-
-static struct keyword keywords[] = 
-{
-    { "int", TERM_COLOR_RED },
-};
-
-termColor_e synGetKeyword(char *tok)
-{
-    for (int i = 0; i < ARRAY_SIZE(keywords); i++)
-    {
-        if (strcmp(tok, keywords[i].key) == 0) return keywords[i].color;
-    }
+    uint32_t seed = synKeywordSeeds[synHash(tok, len, 0) & (SYN_KEYWORD_BUCKETS - 1)];
+    const struct keyword *keyword = &synKeywords[synHash(tok, len, seed) & (SYN_KEYWORD_SLOTS - 1)];
+    if (keyword->len == len && memcmp(keyword->key, tok, len) == 0) return keyword->color;
 
     return TERM_COLOR_NONE;
 }
@@ -36,10 +32,108 @@ size_t synCountKeywords(const char *string)
 
     while (token)
     {
-        if (synGetKeyword(token) != TERM_COLOR_NONE) keywords++;
+        if (synGetKeyword(token, strlen(token)) != TERM_COLOR_NONE) keywords++;
         token = strtok(NULL, " ");
     }
 
     free(str);
     return keywords;
 }
+
+static inline bool synIsIdentChar(char c)
+{
+    return isalnum((unsigned char) c) || c == '_';
+}
+
+/*
+ * Length of the number at the start of s, with its hex digits, fraction, exponent and suffix,
+ * like 0x1f, 10UL or 1.5e-3f
+ */
+static int synNumberLen(const char *s, int len)
+{
+    int i = 1;
+    while (i < len)
+    {
+        char c = s[i];
+        char prev = tolower((unsigned char) s[i - 1]);
+        bool exponentSign = (c == '+' || c == '-') && (prev == 'e' || prev == 'p');
+        if (!synIsIdentChar(c) && c != '.' && !exponentSign) break;
+        i++;
+    }
+
+    return i;
+}
+
+/*
+ * Length of the string or character literal at the start of s, up to and including the closing
+ * quote. One that is not closed on the row runs to its end.
+ */
+static int synQuotedLen(const char *s, int len)
+{
+    int i = 1;
+    while (i < len && s[i] != s[0])
+    {
+        if (s[i] == '\\' && i + 1 < len) i++;
+        i++;
+    }
+
+    return (i < len) ? i + 1 : len;
+}
+
+/*
+ * Length of the comment at the start of s. A block comment that does not end on the row, and
+ * a line comment, run to the end of it.
+ */
+static int synCommentLen(const char *s, int len)
+{
+    if (s[1] == '/') return len;
+
+    for (int i = 2; i + 1 < len; i++)
+    {
+        if (s[i] == '*' && s[i + 1] == '/') return i + 2;
+    }
+
+    return len;
+}
+
+/*
+ * Splits the row into tokens and stores the color of every character in hl, which must have room
+ * for len entries. Comments, string and character literals and numbers have colors of their own,
+ * identifiers are colored if they are keywords. The rows are highlighted on their own, so the
+ * rows inside a block comment are only known to be part of it from where it starts.
+ */
+void synHighlight(const char *string, int len, unsigned char *hl)
+{
+    int i = 0;
+    while (i < len)
+    {
+        const char *s = &string[i];
+        int rest = len - i;
+        int tokLen = 1;
+        termColor_e color = TERM_COLOR_NONE;
+
+        if (s[0] == '/' && rest > 1 && (s[1] == '/' || s[1] == '*'))
+        {
+            tokLen = synCommentLen(s, rest);
+            color = SYN_COLOR_COMMENT;
+        }
+        else if (s[0] == '"' || s[0] == '\'')
+        {
+            tokLen = synQuotedLen(s, rest);
+            color = SYN_COLOR_STRING;
+        }
+        else if (isdigit((unsigned char) s[0]) || (s[0] == '.' && rest > 1 && isdigit((unsigned char) s[1])))
+        {
+            tokLen = synNumberLen(s, rest);
+            color = SYN_COLOR_NUMBER;
+        }
+        else if (synIsIdentChar(s[0]))
+        {
+            while (tokLen < rest && synIsIdentChar(s[tokLen])) tokLen++;
+            color = synGetKeyword(s, tokLen);
+        }
+
+        memset(&hl[i], color, tokLen);
+        i += tokLen;
+    }
+}
@@ -5,4 +5,5 @@
 
 
 size_t synCountKeywords(const char *string);
-termColor_e synGetKeyword(char *tok);
+termColor_e synGetKeyword(const char *tok, int len);
+void synHighlight(const char *string, int len, unsigned char *hl);
@@ -1,26 +1,81 @@
 #include "terminal.h"
+#include "astring.h"
 #include "utils.h"
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <termios.h>
 #include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <assert.h>
 #include <sys/errno.h>
 #include <sys/ioctl.h>
 
+#define TERM_ESC_TIMEOUT_MS 50     // how long to wait for the rest of an escape sequence
+#define TERM_INPUT_SIZE     4096
+#define TERM_QUERY_TIMEOUT_MS 500   // how long to wait for the terminal to answer a query
+#define TERM_QUERY_SYNC_CMD "\x1b[?2026$p\x1b[c"     // the mode of synchronized updates, then the device attributes
+#define TERM_QUERY_SYNC_LEN (sizeof(TERM_QUERY_SYNC_CMD) - 1)
+#define TERM_PASTE_END      "\x1b[201~"
+#define TERM_PASTE_END_LEN  6
+
 static termKey_e termParseBracketKeys();
 static termKey_e termParseXtermKeys();
 
 static struct termios userTerm;
 
+/*
+ * In headless mode the keys come from a buffer instead of stdin, the output goes to outFd,
+ * and the window has a fixed size. Used to replay recorded key scripts.
+ */
+static struct
+{
+    bool enabled;
+    const char *input;
+    size_t inputLen;
+    size_t inputPos;
+    int outFd;
+    int rows;
+    int cols;
+} termHeadless;
+
+/*
+ * Input is read from stdin in chunks, so a burst of keys or a paste takes few syscalls
+ */
+static struct
+{
+    char buf[TERM_INPUT_SIZE];
+    size_t len;
+    size_t pos;
+} termInput;
+
+/*
+ * The terminal is written through a descriptor of its own that doesn't block, so a terminal that
+ * falls behind leaves the rest of a write queued here instead of stalling the editor. It is -1
+ * if the terminal could not be opened again, and then stdout is written instead. The queue is
+ * only emptied once all of it has been sent, so its buffer is reused.
+ */
+static struct
+{
+    int fd;
+    astring *queued;
+    int sent;           // bytes at the start of queued that the terminal has taken
+} termOutput = { -1, NULL, 0 };
+
+static size_t termBytesOut = 0;
+static bool termSyncUpdate = false;     // the terminal supports synchronized updates
+
 
 static void sigHandler(int sig)
 {
     UNUSED(sig);
 
     printf("GOT SIG: %d\n", sig);
+    if (write(STDOUT_FILENO, PASTE_DISABLE_CMD, PASTE_DISABLE_LEN) == -1) {}
 
     // restore starting terminal state
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &userTerm) == -1)
@@ -36,7 +91,6 @@ int termSetupSignals()
     struct sigaction sa = { 0 };
     sa.sa_flags = SA_NODEFER;
     sa.sa_handler = sigHandler;
-    if (sigaction(SIGTERM, &sa, NULL) == -1) return -1;
     if (sigaction(SIGSEGV, &sa, NULL) == -1) return -1;
     return 0;
 }
@@ -71,10 +125,259 @@ void toggleEcho()
 
 }
 
+void termSetHeadless(const char *input, size_t len, int outFd, int rows, int cols)
+{
+    termHeadless.enabled = true;
+    termHeadless.input = input;
+    termHeadless.inputLen = len;
+    termHeadless.inputPos = 0;
+    termHeadless.outFd = outFd;
+    termHeadless.rows = rows;
+    termHeadless.cols = cols;
+}
+
+/*
+ * Checks if there is input that was already read, but not handled yet. In headless mode, these
+ * are the keys left in the script.
+ */
+bool termInputPending()
+{
+    if (termHeadless.enabled) return termHeadless.inputPos < termHeadless.inputLen;
+    return termInput.pos < termInput.len;
+}
+
+/*
+ * Writes as much of buf as fd takes without blocking. Returns the bytes written, or -1 if the
+ * terminal is gone.
+ */
+static ssize_t termWriteSome(int fd, const char *buf, size_t len)
+{
+    size_t written = 0;
+    while (written < len)
+    {
+        ssize_t n = write(fd, &buf[written], len - written);
+        if (n > 0) written += n;
+        else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        else if (n == -1 && errno != EINTR) return -1;
+    }
+
+    termBytesOut += written;
+    return written;
+}
+
+/*
+ * Writes all of buf to fd. If fd can't take more yet, which only happens if it was made
+ * non-blocking, it is waited for with poll.
+ */
+static void termWriteAll(int fd, const char *buf, size_t len)
+{
+    size_t written = 0;
+    while (written < len)
+    {
+        ssize_t n = termWriteSome(fd, &buf[written], len - written);
+        // the terminal is gone, which the next read reports
+        if (n == -1) return;
+        written += n;
+
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        if (written < len && poll(&pfd, 1, -1) == -1 && errno != EINTR) return;
+    }
+}
+
+/*
+ * Writes to the terminal, or to the output of headless mode. What the terminal does not take
+ * right away is queued after the output that is queued already, and written by termFlush.
+ */
+void termWrite(const char *buf, size_t len)
+{
+    if (termOutput.fd == -1)
+    {
+        termWriteAll(termHeadless.enabled ? termHeadless.outFd : STDOUT_FILENO, buf, len);
+        return;
+    }
+
+    if (termOutputQueued() == 0)
+    {
+        ssize_t n = termWriteSome(termOutput.fd, buf, len);
+        if (n == -1) return;
+        buf += n;
+        len -= n;
+    }
+    if (len == 0) return;
+
+    astringAppend(termOutput.queued, buf, len);
+}
+
+/*
+ * Writes as much of the queued output as the terminal takes now
+ */
+void termFlush()
+{
+    size_t queued = termOutputQueued();
+    if (queued == 0) return;
+
+    ssize_t n = termWriteSome(termOutput.fd, astringGetString(termOutput.queued) + termOutput.sent, queued);
+    // nobody is left to read it
+    if (n == -1) n = queued;
+    termOutput.sent += n;
+
+    if (termOutput.sent == astringGetLen(termOutput.queued))
+    {
+        astringClear(termOutput.queued);
+        termOutput.sent = 0;
+    }
+}
+
+/*
+ * Bytes written to the terminal that it has not taken yet
+ */
+size_t termOutputQueued()
+{
+    if (termOutput.queued == NULL) return 0;
+    return astringGetLen(termOutput.queued) - termOutput.sent;
+}
+
+/*
+ * The descriptor to wait on for the terminal to take the queued output, or -1 if none is queued
+ */
+int termOutputFd()
+{
+    return termOutputQueued() ? termOutput.fd : -1;
+}
+
+/*
+ * Bytes written with termWrite so far
+ */
+size_t termBytesWritten()
+{
+    return termBytesOut;
+}
+
+/*
+ * True if frames can be sent as synchronized updates, which the terminal shows at once when
+ * they end instead of while they are drawn
+ */
+bool termHasSyncUpdate()
+{
+    return termSyncUpdate;
+}
+
+bool termIsHeadless()
+{
+    return termHeadless.enabled;
+}
+
+static ssize_t termRead(char *ch)
+{
+    if (termHeadless.enabled)
+    {
+        if (termHeadless.inputPos == termHeadless.inputLen) return 0;
+        *ch = termHeadless.input[termHeadless.inputPos++];
+        return 1;
+    }
+
+    if (termInput.pos == termInput.len)
+    {
+        ssize_t nread = read(STDIN_FILENO, termInput.buf, sizeof(termInput.buf));
+        if (nread <= 0) return nread;
+        termInput.len = nread;
+        termInput.pos = 0;
+    }
+
+    *ch = termInput.buf[termInput.pos++];
+    return 1;
+}
+
+/*
+ * Reads the next byte of an escape sequence. Returns 0 if none arrives in time, which means
+ * that a lone ESC key was pressed.
+ */
+static ssize_t termReadNext(char *ch)
+{
+    if (!termInputPending() && !termHeadless.enabled)
+    {
+        struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+        if (poll(&pfd, 1, TERM_ESC_TIMEOUT_MS) <= 0) return 0;
+    }
+
+    return termRead(ch);
+}
+
+/*
+ * Finds the answer to a query at the start of s. Returns its length and sets final to its last
+ * byte, or returns 0 if s does not start with a complete one.
+ */
+static size_t termParseReply(const char *s, size_t len, char *final)
+{
+    if (len < 3 || s[0] != ESC_KEY || s[1] != '[' || s[2] != '?') return 0;
+
+    for (size_t i = 3; i < len; i++)
+    {
+        if (s[i] >= 0x40 && s[i] <= 0x7e)
+        {
+            *final = s[i];
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Asks the terminal if it supports synchronized updates. Every terminal answers the device
+ * attributes asked for after it, so one that does not know the mode doesn't keep us waiting.
+ * Keys that arrive along with the answers are kept as input.
+ */
+static void termQuerySyncUpdate()
+{
+    termWrite(TERM_QUERY_SYNC_CMD, TERM_QUERY_SYNC_LEN);
+
+    char buf[TERM_INPUT_SIZE];
+    size_t len = 0;
+    bool answered = false;
+    while (!answered && len < sizeof(buf))
+    {
+        struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+        if (poll(&pfd, 1, TERM_QUERY_TIMEOUT_MS) <= 0) break;
+        ssize_t nread = read(STDIN_FILENO, &buf[len], sizeof(buf) - len);
+        if (nread <= 0) break;
+        len += nread;
+
+        // the mode is reported as CSI ? 2026 ; n $ y, where 1 and 2 mean it is known. Answers
+        // that only arrived in part are completed by the next read.
+        size_t i = 0;
+        while (i < len)
+        {
+            char final;
+            size_t replyLen = termParseReply(&buf[i], len - i, &final);
+            if (replyLen == 0)
+            {
+                i++;
+                continue;
+            }
+
+            if (final == 'c') answered = true;
+            if (final == 'y' && replyLen >= 10 && memcmp(&buf[i], "\x1b[?2026;", 8) == 0)
+            {
+                termSyncUpdate = (buf[i + 8] == '1' || buf[i + 8] == '2');
+            }
+
+            memmove(&buf[i], &buf[i + replyLen], len - i - replyLen);
+            len -= replyLen;
+        }
+    }
+
+    memcpy(termInput.buf, buf, len);
+    termInput.len = len;
+    termInput.pos = 0;
+}
+
 int termEnableRawMode()
 {
     struct termios term;
 
+    if (termHeadless.enabled) return 0;
+
     if (tcgetattr(STDIN_FILENO, &term) == -1) return -1;
 
     // copy the startup state of the terminal so we can restore later
@@ -85,16 +388,38 @@ int termEnableRawMode()
             INPCK | ISTRIP | IXON | PARMRK);
     term.c_oflag &= ~OPOST;
 
-    term.c_cc[VMIN] = 0;    // make it a pure timed read
-    term.c_cc[VTIME] = 1;   // set read timeout to 100 ms
+    term.c_cc[VMIN] = 1;    // block until there is a key, the event loop waits for it with poll
+    term.c_cc[VTIME] = 0;
 
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &term) == -1) return -1;
 
+    // stdout is shared with the shell, so it stays blocking and the terminal is opened again
+    const char *tty = ttyname(STDOUT_FILENO);
+    if (tty) termOutput.fd = open(tty, O_WRONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+    if (termOutput.fd != -1) termOutput.queued = astringNew();
+
+    // pasted text is sent between markers, instead of as typed keys
+    termWrite(PASTE_ENABLE_CMD, PASTE_ENABLE_LEN);
+    termQuerySyncUpdate();
+
     return 0;
 }
 
 int termDisableRawMode()
 {
+    if (termHeadless.enabled) return 0;
+
+    termWrite(PASTE_DISABLE_CMD, PASTE_DISABLE_LEN);
+    if (termOutput.fd != -1)
+    {
+        termWriteAll(termOutput.fd, astringGetString(termOutput.queued) + termOutput.sent, termOutputQueued());
+        close(termOutput.fd);
+        astringFree(&termOutput.queued);
+        termOutput.fd = -1;
+        termOutput.queued = NULL;
+        termOutput.sent = 0;
+    }
+
     // restore the saved config
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &userTerm) == -1) return -1;
     return 0;
@@ -106,6 +431,13 @@ int termGetWindowSize(int *rows, int *cols)
     // implement the ioctl
     struct winsize ws;
 
+    if (termHeadless.enabled)
+    {
+        *rows = termHeadless.rows;
+        *cols = termHeadless.cols;
+        return 0;
+    }
+
     if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
     {
         return -1;
@@ -123,16 +455,21 @@ termKey_e termReadKey()
 {
     char ch = '\0';
     ssize_t nread;
-    while ((nread = read(STDIN_FILENO, &ch, 1)) != 1)
+
+    // a script that ends in the middle of a prompt cancels it
+    if (termHeadless.enabled && !termInputPending()) return ESC_KEY;
+
+    while ((nread = termRead(&ch)) != 1)
     {
-        if (nread == -1 && errno != EAGAIN) errExit("Failed to read input key");
+        if (nread == 0) errExit("Terminal closed");
+        if (errno != EAGAIN && errno != EINTR) errExit("Failed to read input key");
     }
 
     if (ch == ESC_KEY)
     {
         // If read times out or failes, assume user only pressed ESC key and return that
         char controlChar;
-        if (read(STDIN_FILENO, &controlChar, 1) != 1) return ESC_KEY;
+        if (termReadNext(&controlChar) != 1) return ESC_KEY;
 
         if (controlChar == LEFT_BRACKET)
         {
@@ -147,13 +484,57 @@ termKey_e termReadKey()
     return ch;
 }
 
-char *termGetColor(termColor_e color)
+/*
+ * Reads the text of a bracketed paste, after termReadKey returned PASTE_START. Returns the text,
+ * which the caller frees, and its length in len.
+ */
+char *termReadPaste(size_t *len)
+{
+    size_t capacity = TERM_INPUT_SIZE;
+    char *text = malloc(capacity);
+    assert(text != NULL);
+    size_t textLen = 0;
+
+    char ch;
+    ssize_t nread;
+    while ((nread = termRead(&ch)) != 0)
+    {
+        if (nread == -1)
+        {
+            if (errno == EAGAIN || errno == EINTR) continue;
+            break;
+        }
+
+        if (textLen == capacity)
+        {
+            capacity *= 2;
+            text = realloc(text, capacity);
+            assert(text != NULL);
+        }
+        text[textLen++] = ch;
+
+        if (textLen >= TERM_PASTE_END_LEN && memcmp(&text[textLen - TERM_PASTE_END_LEN], TERM_PASTE_END, TERM_PASTE_END_LEN) == 0)
+        {
+            textLen -= TERM_PASTE_END_LEN;
+            break;
+        }
+    }
+
+    *len = textLen;
+    return text;
+}
+
+const char *termGetColor(termColor_e color)
 {
     switch(color)
     {
         case TERM_COLOR_NONE: return "";
         case TERM_COLOR_WHITE: return FG_COLOR_WHITE;
         case TERM_COLOR_RED: return FG_COLOR_RED;
+        case TERM_COLOR_GREEN: return FG_COLOR_GREEN;
+        case TERM_COLOR_YELLOW: return FG_COLOR_YELLOW;
+        case TERM_COLOR_BLUE: return FG_COLOR_BLUE;
+        case TERM_COLOR_MAGENTA: return FG_COLOR_MAGENTA;
         case TERM_COLOR_RESET: return FG_COLOR_RESET;
     }
 
@@ -163,24 +544,45 @@ char *termGetColor(termColor_e color)
 static termKey_e termParseBracketKeys()
 {
     char seq[2];
-    if (read(STDIN_FILENO, &seq[0], 1) != 1) return ESC_KEY;
+    if (termReadNext(&seq[0]) != 1) return ESC_KEY;
 
-    if (seq[0] >= '1' && seq[0] <= '9')
+    if (seq[0] == '?')
+    {
+        // an answer to a query that came after termQuerySyncUpdate gave up on it. It is read up
+        // to its final byte, so that none of it is taken for typed keys.
+        do
+        {
+            if (termReadNext(&seq[1]) != 1) return IDLE_KEY;
+        } while (seq[1] < 0x40 || seq[1] > 0x7e);
+
+        return IDLE_KEY;
+    }
+
+    if (seq[0] >= '0' && seq[0] <= '9')
     {
         // For the VT sequence of the Page keys, eg PageUp, the command is <ESC>[5~
-        if (read(STDIN_FILENO, &seq[1], 1) != 1) return ESC_KEY;
+        // and a paste starts with <ESC>[200~
+        int num = seq[0] - '0';
+        while (1)
+        {
+            if (termReadNext(&seq[1]) != 1) return ESC_KEY;
+            if (seq[1] < '0' || seq[1] > '9' || num > 1000) break;
+            num = num * 10 + seq[1] - '0';
+        }
+
         if (seq[1] == '~')
         {
-            switch(seq[0])
+            switch(num)
             {
-                case '1': // 2 for HOME
-                case '7': return HOME;
-                case '2': return INSERT;
-                case '3': return DELETE;
-                case '4': // 2 for END
-                case '8': return END;
-                case '5': return PAGE_UP;
-                case '6': return PAGE_DOWN;
+                case 1: // 2 for HOME
+                case 7: return HOME;
+                case 2: return INSERT;
+                case 3: return DELETE;
+                case 4: // 2 for END
+                case 8: return END;
+                case 5: return PAGE_UP;
+                case 6: return PAGE_DOWN;
+                case 200: return PASTE_START;
             }
         }
     }
@@ -205,7 +607,7 @@ static termKey_e termParseBracketKeys()
 static termKey_e termParseXtermKeys()
 {
     char ch;
-    if (read(STDIN_FILENO, &ch, 1) != 1) return ESC_KEY;
+    if (termReadNext(&ch) != 1) return ESC_KEY;
 
     switch (ch)
     {
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #define CURSOR_ORIGIN_CMD       "\x1b[H"
 #define CURSOR_ORIGIN_LEN       3
 #define CURSOR_HIDE_CMD         "\x1b[?25l"
@@ -10,6 +13,14 @@
 #define DISPLAY_ERASE_ALL_LEN   4
 #define DISPLAY_ERASE_LINE_CMD  "\x1b[K"
 #define DISPLAY_ERASE_LINE_LEN  3
+#define PASTE_ENABLE_CMD        "\x1b[?2004h"
+#define PASTE_ENABLE_LEN        8
+#define PASTE_DISABLE_CMD       "\x1b[?2004l"
+#define PASTE_DISABLE_LEN       8
+#define SYNC_BEGIN_CMD          "\x1b[?2026h"
+#define SYNC_BEGIN_LEN          8
+#define SYNC_END_CMD            "\x1b[?2026l"
+#define SYNC_END_LEN            8
 
 
 #define FG_COLOR_SIZE       9           // a color + reset
@@ -17,12 +28,20 @@
 #define FG_COLOR_RESET_SIZE 4
 #define FG_COLOR_WHITE      "\x1b[30m"
 #define FG_COLOR_RED        "\x1b[31m"
+#define FG_COLOR_GREEN      "\x1b[32m"
+#define FG_COLOR_YELLOW     "\x1b[33m"
+#define FG_COLOR_BLUE       "\x1b[34m"
+#define FG_COLOR_MAGENTA    "\x1b[35m"
 
 typedef enum
 {
     TERM_COLOR_NONE,
     TERM_COLOR_WHITE,
     TERM_COLOR_RED,
+    TERM_COLOR_GREEN,
+    TERM_COLOR_YELLOW,
+    TERM_COLOR_BLUE,
+    TERM_COLOR_MAGENTA,
     TERM_COLOR_RESET,
 } termColor_e;
 
@@ -46,11 +65,27 @@ typedef enum
     END,
     PAGE_UP,
     PAGE_DOWN,
+
+    // the start of a bracketed paste, the text is read with termReadPaste
+    PASTE_START,
+
+    // no key was pressed, but something else needs the screen refreshed
+    IDLE_KEY,
 } termKey_e;
 
 int termSetupSignals();
+void termSetHeadless(const char *input, size_t len, int outFd, int rows, int cols);
+bool termIsHeadless();
+bool termInputPending();
+void termWrite(const char *buf, size_t len);
+size_t termBytesWritten();
+void termFlush();
+size_t termOutputQueued();
+int termOutputFd();
+bool termHasSyncUpdate();
 int termEnableRawMode();
 int termDisableRawMode();
 int termGetWindowSize(int *rows, int *cols);
 termKey_e termReadKey();
-char *termGetColor(termColor_e color);
+char *termReadPaste(size_t *len);
+const char *termGetColor(termColor_e color);
@@ -0,0 +1,316 @@
+#include "undo.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * The undo history is a log of edit operations. Each entry records where text was inserted or
+ * deleted, and the text itself lives in one shared text buffer, so the log costs little more than
+ * the edited text. Typing extends the last entry instead of adding a new one: characters typed one
+ * after the other become a single insert, and repeated backspace or delete a single delete.
+ *
+ * Entries are grouped, and undo and redo always handle a whole group. A group ends when the
+ * editor calls undoBreak (for example when the cursor is moved), or when the edit switches
+ * between inserting and deleting.
+ *
+ * The oldest groups are dropped when the log uses more than the configured limit.
+ */
+
+typedef struct
+{
+    undoType_e type;
+    bool reversed;      // the text is stored back to front, for a run of backspaces
+    int row;
+    int col;
+    int len;
+    unsigned group;
+    size_t textOffset;
+} undoEntry_s;
+
+struct undo_s
+{
+    undoEntry_s *entries;
+    int numEntries;
+    int capacity;
+    int pos;            // entries before pos are applied, the ones after it can be redone
+
+    char *text;
+    size_t textLen;
+    size_t textCapacity;
+
+    size_t limit;
+    unsigned group;
+    bool broken;        // the next record starts a new group
+
+    // where the last entry ends, to see if the next record continues it
+    int endRow;
+    int endCol;
+
+    char *scratch;      // text of a reversed entry, in the right order
+    size_t scratchCapacity;
+};
+
+
+undo *undoNew(size_t limit)
+{
+    undo *u = calloc(1, sizeof(*u));
+    assert(u != NULL);
+    u->limit = limit;
+    u->broken = true;
+
+    return u;
+}
+
+void undoFree(undo **u)
+{
+    if (*u == NULL) return;
+    free((*u)->entries);
+    free((*u)->text);
+    free((*u)->scratch);
+    free(*u);
+    *u = NULL;
+}
+
+/*
+ * Makes the next recorded edit start a new group
+ */
+void undoBreak(undo *u)
+{
+    u->broken = true;
+}
+
+/*
+ * Position after text that starts at (row, col)
+ */
+static void undoTextEnd(int row, int col, const char *text, int len, int *endRow, int *endCol)
+{
+    *endRow = row;
+    *endCol = col;
+    for (int i = 0; i < len; i++)
+    {
+        if (text[i] == '\n')
+        {
+            (*endRow)++;
+            *endCol = 0;
+        }
+        else
+        {
+            (*endCol)++;
+        }
+    }
+}
+
+static void undoAppendText(undo *u, const char *text, int len)
+{
+    // rows that are added or removed empty have no text, and the log may have none yet
+    if (len == 0) return;
+
+    if (u->textLen + len > u->textCapacity)
+    {
+        u->textCapacity = (u->textLen + len) * 2;
+        u->text = realloc(u->text, u->textCapacity);
+        assert(u->text != NULL);
+    }
+
+    memcpy(&u->text[u->textLen], text, len);
+    u->textLen += len;
+}
+
+static void undoReverse(char *text, int len)
+{
+    for (int i = 0, j = len - 1; i < j; i++, j--)
+    {
+        char c = text[i];
+        text[i] = text[j];
+        text[j] = c;
+    }
+}
+
+static void undoAppendReversed(undo *u, const char *text, int len)
+{
+    for (int i = len - 1; i >= 0; i--) undoAppendText(u, &text[i], 1);
+}
+
+static inline size_t undoSize(undo *u)
+{
+    return u->numEntries * sizeof(*u->entries) + u->textLen;
+}
+
+/*
+ * Drops the oldest groups until the log is well below the limit. The group that is being
+ * recorded is always kept.
+ */
+static void undoTrim(undo *u)
+{
+    if (undoSize(u) <= u->limit) return;
+
+    size_t target = u->limit / 4 * 3;
+    int drop = 0;
+    while (drop < u->numEntries && u->entries[drop].group != u->group)
+    {
+        // only drop whole groups
+        unsigned group = u->entries[drop].group;
+        while (drop < u->numEntries && u->entries[drop].group == group) drop++;
+
+        size_t textDropped = (drop < u->numEntries) ? u->entries[drop].textOffset : u->textLen;
+        size_t size = (u->numEntries - drop) * sizeof(*u->entries) + u->textLen - textDropped;
+        if (size <= target) break;
+    }
+
+    if (drop == 0) return;
+
+    size_t textDropped = (drop < u->numEntries) ? u->entries[drop].textOffset : u->textLen;
+    memmove(u->entries, &u->entries[drop], sizeof(*u->entries) * (u->numEntries - drop));
+    memmove(u->text, &u->text[textDropped], u->textLen - textDropped);
+    u->numEntries -= drop;
+    u->pos -= drop;
+    u->textLen -= textDropped;
+    for (int i = 0; i < u->numEntries; i++) u->entries[i].textOffset -= textDropped;
+}
+
+/*
+ * Tries to extend the last entry with the edit. Returns false if it has to be a new entry.
+ */
+static bool undoMerge(undo *u, undoType_e type, int row, int col, const char *text, int len)
+{
+    if (u->broken || u->numEntries == 0) return false;
+
+    undoEntry_s *last = &u->entries[u->numEntries - 1];
+    if (last->type != type || type == UNDO_ADD_ROW) return false;
+
+    if (type == UNDO_INSERT)
+    {
+        // typing continues where the last insert ended
+        if (row != u->endRow || col != u->endCol) return false;
+        undoAppendText(u, text, len);
+        last->len += len;
+        undoTextEnd(row, col, text, len, &u->endRow, &u->endCol);
+        return true;
+    }
+
+    // delete at the same position, the text after it moves up
+    if (!last->reversed && row == last->row && col == last->col)
+    {
+        undoAppendText(u, text, len);
+        last->len += len;
+        return true;
+    }
+
+    // backspace, the deleted text ends where the last delete started
+    int endRow, endCol;
+    undoTextEnd(row, col, text, len, &endRow, &endCol);
+    if (endRow == last->row && endCol == last->col)
+    {
+        // the entry is stored back to front from now on. Its text is the last in the log.
+        if (!last->reversed) undoReverse(&u->text[last->textOffset], last->len);
+        undoAppendReversed(u, text, len);
+        last->reversed = true;
+        last->row = row;
+        last->col = col;
+        last->len += len;
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * Records an edit that was just made. Anything that could be redone is forgotten.
+ */
+void undoRecord(undo *u, undoType_e type, int row, int col, const char *text, int len)
+{
+    if (u->pos < u->numEntries)
+    {
+        u->textLen = u->entries[u->pos].textOffset;
+        u->numEntries = u->pos;
+        u->broken = true;
+    }
+
+    // inserting and deleting are separate groups, adding a row is part of typing
+    if (u->numEntries > 0)
+    {
+        bool lastDelete = u->entries[u->numEntries - 1].type == UNDO_DELETE;
+        if (lastDelete != (type == UNDO_DELETE)) u->broken = true;
+    }
+
+    if (!undoMerge(u, type, row, col, text, len))
+    {
+        if (u->broken) u->group++;
+
+        if (u->numEntries == u->capacity)
+        {
+            u->capacity = u->capacity ? u->capacity * 2 : 64;
+            u->entries = realloc(u->entries, sizeof(*u->entries) * u->capacity);
+            assert(u->entries != NULL);
+        }
+
+        undoEntry_s *entry = &u->entries[u->numEntries++];
+        entry->type = type;
+        entry->reversed = false;
+        entry->row = row;
+        entry->col = col;
+        entry->len = len;
+        entry->group = u->group;
+        entry->textOffset = u->textLen;
+        undoAppendText(u, text, len);
+        undoTextEnd(row, col, text, len, &u->endRow, &u->endCol);
+    }
+
+    u->broken = false;
+    u->pos = u->numEntries;
+    undoTrim(u);
+}
+
+static void undoGetOp(undo *u, undoEntry_s *entry, undoOp_s *op)
+{
+    op->type = entry->type;
+    op->row = entry->row;
+    op->col = entry->col;
+    op->len = entry->len;
+    op->text = &u->text[entry->textOffset];
+
+    if (entry->reversed)
+    {
+        if ((size_t) entry->len > u->scratchCapacity)
+        {
+            u->scratchCapacity = entry->len;
+            u->scratch = realloc(u->scratch, u->scratchCapacity);
+            assert(u->scratch != NULL);
+        }
+
+        for (int i = 0; i < entry->len; i++) u->scratch[i] = op->text[entry->len - 1 - i];
+        op->text = u->scratch;
+    }
+}
+
+/*
+ * Returns the next operation to revert. more is set if the one after it belongs to the same group,
+ * and must be reverted too. The text in op is valid until the next call.
+ */
+bool undoUndo(undo *u, undoOp_s *op, bool *more)
+{
+    if (u->pos == 0) return false;
+
+    undoEntry_s *entry = &u->entries[--u->pos];
+    undoGetOp(u, entry, op);
+    *more = u->pos > 0 && u->entries[u->pos - 1].group == entry->group;
+    u->broken = true;
+
+    return true;
+}
+
+/*
+ * Returns the next operation to apply again, see undoUndo
+ */
+bool undoRedo(undo *u, undoOp_s *op, bool *more)
+{
+    if (u->pos == u->numEntries) return false;
+
+    undoEntry_s *entry = &u->entries[u->pos++];
+    undoGetOp(u, entry, op);
+    *more = u->pos < u->numEntries && u->entries[u->pos].group == entry->group;
+    u->broken = true;
+
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct undo_s undo;
+
+typedef enum
+{
+    UNDO_INSERT,        // text was inserted at (row, col)
+    UNDO_DELETE,        // text was deleted from (row, col)
+    UNDO_ADD_ROW,       // an empty row was added at the end, at index row
+} undoType_e;
+
+typedef struct
+{
+    undoType_e type;
+    int row;
+    int col;
+    const char *text;   // a '\n' in the text is a line break
+    int len;
+} undoOp_s;
+
+undo *undoNew(size_t limit);
+void undoFree(undo **u);
+void undoRecord(undo *u, undoType_e type, int row, int col, const char *text, int len);
+void undoBreak(undo *u);
+bool undoUndo(undo *u, undoOp_s *op, bool *more);
+bool undoRedo(undo *u, undoOp_s *op, bool *more);
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+
+#define UTF8_INVALID            0xFFFFFFFFu     // decoded from a byte that does not start a valid sequence
+#define UTF8_REPLACEMENT        "\xEF\xBF\xBD"  // U+FFFD, drawn in place of invalid bytes
+#define UTF8_REPLACEMENT_LEN    3
+
+int utf8Decode(const char *s, int len, uint32_t *cp);
+int utf8Width(uint32_t cp);
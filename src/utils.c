@@ -21,3 +21,4 @@ void err_exit(const char *file, const char *func, int line, const char *fmt, ...
 
     exit(EXIT_SUCCESS);
 }
+
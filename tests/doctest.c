@@ -0,0 +1,110 @@
+#define _DEFAULT_SOURCE
+
+#include "nedtest.h"
+#include "document.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ * Offsets in a document count one newline per row, also in a file loaded with CRLF line
+ * endings, which is how the document is saved
+ */
+static int testCrlfOffsets()
+{
+    char filename[] = "/tmp/nedtest-XXXXXX";
+    int fd = mkstemp(filename);
+    TEST_CHECK(fd != -1);
+    const char *text = "one\r\ntwo\r\n\r\nfour";
+    TEST_CHECK(write(fd, text, strlen(text)) == (ssize_t) strlen(text));
+    close(fd);
+
+    document *doc = docNew();
+    int loaded = docLoadFile(doc, filename);
+    unlink(filename);
+    TEST_CHECK(loaded == 0);
+
+    // "one\ntwo\n\nfour\n"
+    TEST_CHECK(docNumRows(doc) == 4);
+    TEST_CHECK(docRowOffset(doc, 1) == 4);
+    TEST_CHECK(docRowOffset(doc, 2) == 8);
+    TEST_CHECK(docRowOffset(doc, 3) == 9);
+    TEST_CHECK(docSize(doc) == 14);
+    TEST_CHECK(docRowAtOffset(doc, 3) == 0);
+    TEST_CHECK(docRowAtOffset(doc, 4) == 1);
+    TEST_CHECK(docRowAtOffset(doc, 9) == 3);
+
+    docFree(&doc);
+    return 0;
+}
+
+/*
+ * Saves a document with one row to filename
+ */
+static int docTestSave(const char *filename, const char *text)
+{
+    document *doc = docNew();
+    edRow_s *row = docInsertRow(doc, 0);
+    int len = strlen(text);
+    docRowReserve(doc, row, len);
+    memcpy(row->string, text, len);
+    row->size = len;
+    docRowChanged(doc, row);
+
+    docSnapshot *snap = docSnapshotNew(doc);
+    int ret = docSnapshotSave(snap, filename);
+    docSnapshotFree(&snap);
+    docFree(&doc);
+    return ret;
+}
+
+/*
+ * Saving replaces the file a symlink points to and keeps its owner and permissions, and a new
+ * file gets the permissions the umask allows
+ */
+static int testSaveKeepsFile()
+{
+    char dir[] = "/tmp/nedtest-XXXXXX";
+    TEST_CHECK(mkdtemp(dir) != NULL);
+    char target[64], link[64], fresh[64];
+    snprintf(target, sizeof(target), "%s/target", dir);
+    snprintf(link, sizeof(link), "%s/link", dir);
+    snprintf(fresh, sizeof(fresh), "%s/fresh", dir);
+
+    TEST_CHECK(docTestSave(target, "old") == 0);
+    TEST_CHECK(chmod(target, 0640) == 0);
+    // giving the file away only works as root, otherwise the owner is ours anyway
+    struct stat before;
+    TEST_CHECK(stat(target, &before) == 0);
+    if (getuid() == 0 && chown(target, 1, 1) == 0) before.st_uid = before.st_gid = 1;
+    TEST_CHECK(symlink("target", link) == 0);
+
+    TEST_CHECK(docTestSave(link, "new") == 0);
+
+    struct stat sb;
+    TEST_CHECK(lstat(link, &sb) == 0 && S_ISLNK(sb.st_mode));
+    TEST_CHECK(stat(target, &sb) == 0);
+    TEST_CHECK(sb.st_size == 4);
+    TEST_CHECK((sb.st_mode & 07777) == 0640);
+    TEST_CHECK(sb.st_uid == before.st_uid && sb.st_gid == before.st_gid);
+
+    mode_t mask = umask(0);
+    umask(mask);
+    TEST_CHECK(docTestSave(fresh, "new") == 0);
+    TEST_CHECK(stat(fresh, &sb) == 0);
+    TEST_CHECK((sb.st_mode & 07777) == (0666 & ~mask));
+
+    unlink(fresh);
+    unlink(link);
+    unlink(target);
+    rmdir(dir);
+    return 0;
+}
+
+int testDocument()
+{
+    if (testCrlfOffsets() != 0) return -1;
+    return testSaveKeepsFile();
+}
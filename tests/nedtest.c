@@ -0,0 +1,45 @@
+#include "nedtest.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+typedef int (*testFunc)(void);
+
+struct test
+{
+    const char *name;
+    testFunc func;
+};
+
+static struct test tests[] =
+{
+    { "document", testDocument },
+    { "terminal", testTerminal },
+    { "regexp", testRegexp },
+    { "undo", testUndo },
+    { "syntax", testSyntax },
+};
+
+
+/*
+ * Runs the tests named on the command line, or all of them. Returns non-zero if any fails.
+ */
+int main(int argc, char **argv)
+{
+    int numTests = sizeof(tests) / sizeof(tests[0]);
+    int failed = 0;
+
+    for (int i = 0; i < numTests; i++)
+    {
+        bool selected = (argc < 2);
+        for (int j = 1; j < argc; j++) selected = selected || strcmp(argv[j], tests[i].name) == 0;
+        if (!selected) continue;
+
+        int ret = tests[i].func();
+        printf("%-12s %s\n", tests[i].name, ret == 0 ? "ok" : "FAILED");
+        if (ret != 0) failed++;
+    }
+
+    return failed ? 1 : 0;
+}
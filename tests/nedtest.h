@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdio.h>
+
+/*
+ * Reports a failed check with its location, and fails the test it is in
+ */
+#define TEST_CHECK(cond) \
+    do \
+    { \
+        if (!(cond)) \
+        { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return -1; \
+        } \
+    } while (0)
+
+int testDocument();
+int testTerminal();
+int testRegexp();
+int testUndo();
+int testSyntax();
@@ -0,0 +1,144 @@
+#include "nedtest.h"
+#include "regexp.h"
+
+#include <string.h>
+
+#define REGEX_FLUSH_MIN     900     // a range of line lengths around the size of the DFA cache
+#define REGEX_FLUSH_MAX     1200
+
+/*
+ * Checks that the pattern is first found in string at [start, end) when searching from from,
+ * or not at all when start is -1
+ */
+static int regexTestFind(const char *pattern, const char *string, int from, int start, int end)
+{
+    const char *error = NULL;
+    regexp *re = regexpCompile(pattern, &error);
+    TEST_CHECK(re != NULL);
+
+    int foundStart = -1, foundEnd = -1;
+    bool found = regexpFind(re, string, strlen(string), from, &foundStart, &foundEnd);
+    regexpFree(&re);
+
+    if (found != (start != -1) || foundStart != start || (found && foundEnd != end))
+    {
+        printf("'%s' in '%s' from %d: got %d-%d, expected %d-%d\n",
+                pattern, string, from, found ? foundStart : -1, foundEnd, start, end);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Same as regexTestFind, for the last match that starts before before
+ */
+static int regexTestFindLast(const char *pattern, const char *string, int before, int start, int end)
+{
+    const char *error = NULL;
+    regexp *re = regexpCompile(pattern, &error);
+    TEST_CHECK(re != NULL);
+
+    int foundStart = -1, foundEnd = -1;
+    bool found = regexpFindLast(re, string, strlen(string), before, &foundStart, &foundEnd);
+    regexpFree(&re);
+
+    if (found != (start != -1) || foundStart != start || (found && foundEnd != end))
+    {
+        printf("'%s' in '%s' before %d: got %d-%d, expected %d-%d\n",
+                pattern, string, before, found ? foundStart : -1, foundEnd, start, end);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int testAnchors()
+{
+    TEST_CHECK(regexTestFind("^abc", "abcabc", 0, 0, 3) == 0);
+    TEST_CHECK(regexTestFind("^abc", "abcabc", 1, -1, -1) == 0);
+    TEST_CHECK(regexTestFind("abc$", "abcabc", 0, 3, 6) == 0);
+    TEST_CHECK(regexTestFind("^abc$", "abcabc", 0, -1, -1) == 0);
+    TEST_CHECK(regexTestFind("^$", "", 0, 0, 0) == 0);
+    TEST_CHECK(regexTestFind("^x*", "xxy", 0, 0, 2) == 0);
+    TEST_CHECK(regexTestFind("y$", "xxy", 1, 2, 3) == 0);
+    return 0;
+}
+
+static int testClasses()
+{
+    TEST_CHECK(regexTestFind("[a-c]+", "xxbcaz", 0, 2, 5) == 0);
+    TEST_CHECK(regexTestFind("[^x]+", "xxbcaz", 0, 2, 6) == 0);
+    TEST_CHECK(regexTestFind("\\d+", "ab123c", 0, 2, 5) == 0);
+    TEST_CHECK(regexTestFind("\\w+\\s", "  foo_1 bar", 0, 2, 8) == 0);
+    TEST_CHECK(regexTestFind("a.c", "abxac", 0, -1, -1) == 0);
+    TEST_CHECK(regexTestFind("ABC", "xabc", 0, 1, 4) == 0);
+    TEST_CHECK(regexTestFind("x{2,3}", "xyxxxxx", 0, 2, 5) == 0);
+    return 0;
+}
+
+static int testAlternation()
+{
+    // the leftmost match wins, and of those starting there the longest
+    TEST_CHECK(regexTestFind("a|ab", "xab", 0, 1, 3) == 0);
+    TEST_CHECK(regexTestFind("b|ab", "xab", 0, 1, 3) == 0);
+    TEST_CHECK(regexTestFind("(foo|foobar)baz", "foobarbaz", 0, 0, 9) == 0);
+    TEST_CHECK(regexTestFind("cat|dog", "hotdog cat", 0, 3, 6) == 0);
+    TEST_CHECK(regexTestFind("cat|dog", "hotdog cat", 4, 7, 10) == 0);
+    TEST_CHECK(regexTestFind("(a|b)*c", "xababcab", 0, 1, 6) == 0);
+    return 0;
+}
+
+static int testFindLast()
+{
+    TEST_CHECK(regexTestFindLast("ab", "ab ab ab", 8, 6, 8) == 0);
+    TEST_CHECK(regexTestFindLast("ab", "ab ab ab", 6, 3, 5) == 0);
+    TEST_CHECK(regexTestFindLast("ab", "ab ab ab", 1, 0, 2) == 0);
+    TEST_CHECK(regexTestFindLast("ab", "ab ab ab", 0, -1, -1) == 0);
+    TEST_CHECK(regexTestFindLast("^ab", "ab ab ab", 8, 0, 2) == 0);
+    TEST_CHECK(regexTestFindLast("b+$", "abbb", 4, 3, 4) == 0);
+    return 0;
+}
+
+/*
+ * Fills the DFA cache with the states that count the 'a's after an 'x', goes back to the start
+ * state with a 'k' and then leaves it on a new transition, so the cache is flushed while in the
+ * first state. The lengths around the size of the cache are all tried, so one of them does that.
+ */
+static int testDfaFlush()
+{
+    char line[REGEX_FLUSH_MAX + 8];
+
+    for (int n = REGEX_FLUSH_MIN; n < REGEX_FLUSH_MAX; n++)
+    {
+        const char *error = NULL;
+        regexp *re = regexpCompile("x([ab]{100}){11}y|ff", &error);
+        TEST_CHECK(re != NULL);
+
+        int len = 0;
+        line[len++] = 'x';
+        memset(&line[len], 'a', n);
+        len += n;
+        memcpy(&line[len], "kff", 3);
+        len += 3;
+
+        int start = -1, end = -1;
+        bool found = regexpFind(re, line, len, 0, &start, &end);
+        regexpFree(&re);
+
+        TEST_CHECK(found);
+        TEST_CHECK(start == n + 2);
+        TEST_CHECK(end == n + 4);
+    }
+
+    return 0;
+}
+
+int testRegexp()
+{
+    if (testAnchors() != 0) return -1;
+    if (testClasses() != 0) return -1;
+    if (testAlternation() != 0) return -1;
+    if (testFindLast() != 0) return -1;
+    return testDfaFlush();
+}
@@ -0,0 +1,51 @@
+#include "nedtest.h"
+#include "syntax.h"
+
+#include <string.h>
+
+/*
+ * Checks the colors of a row, given as one letter per character: k for a keyword, y for a number
+ * or a constant, c for a comment, s for a string and . for no color
+ */
+static int synTestRow(const char *row, const char *expect)
+{
+    int len = strlen(row);
+    unsigned char hl[256];
+    synHighlight(row, len, hl);
+
+    for (int i = 0; i < len; i++)
+    {
+        char got = '.';
+        if (hl[i] == TERM_COLOR_BLUE) got = 'c';
+        else if (hl[i] == TERM_COLOR_MAGENTA) got = 's';
+        else if (hl[i] == TERM_COLOR_YELLOW) got = 'y';
+        else if (hl[i] != TERM_COLOR_NONE) got = 'k';
+        if (got != expect[i])
+        {
+            printf("'%s'\n expected %s\n at %d: '%c' instead of '%c'\n", row, expect, i, got, expect[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int testTokens()
+{
+    TEST_CHECK(synTestRow("int x = 10;", "kkk.....yy.") == 0);
+    TEST_CHECK(synTestRow("f(0x1fUL, 1.5e-3f, .5)", "..yyyyyy..yyyyyyy..yy.") == 0);
+    TEST_CHECK(synTestRow("x1 = y2;", "........") == 0);
+    TEST_CHECK(synTestRow("s = \"if \\\"for\\\"\";", "....ssssssssssss.") == 0);
+    TEST_CHECK(synTestRow("c = '\\'';", "....ssss.") == 0);
+    TEST_CHECK(synTestRow("return 1; // if else", "kkkkkk.y..cccccccccc") == 0);
+    TEST_CHECK(synTestRow("a /* if */ while", "..cccccccc.kkkkk") == 0);
+    TEST_CHECK(synTestRow("x = \"open while", "....sssssssssss") == 0);
+    TEST_CHECK(synTestRow("y /* open while", "..ccccccccccccc") == 0);
+    TEST_CHECK(synTestRow("p = NULL / 2;", "....yyyy...y.") == 0);
+    return 0;
+}
+
+int testSyntax()
+{
+    return testTokens();
+}
@@ -0,0 +1,111 @@
+#define _DEFAULT_SOURCE
+
+#include "nedtest.h"
+#include "terminal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define TERM_TEST_ANSWER_MS 250     // well below the timeout of the query
+
+static long termTestNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Plays the terminal on the master side of a pty: answers the queries once they have arrived
+ * whole, like a terminal that supports synchronized updates would
+ */
+static void termTestAnswer(int master, pid_t child)
+{
+    char buf[256];
+    size_t len = 0;
+    bool modeAnswered = false, attrsAnswered = false;
+
+    while (waitpid(child, NULL, WNOHANG) == 0)
+    {
+        struct pollfd pfd = { .fd = master, .events = POLLIN };
+        if (poll(&pfd, 1, 10) <= 0) continue;
+        ssize_t nread = read(master, &buf[len], sizeof(buf) - 1 - len);
+        if (nread <= 0) return;
+        len += nread;
+        buf[len] = '\0';
+
+        if (!modeAnswered && strstr(buf, "\x1b[?2026$p"))
+        {
+            modeAnswered = (write(master, "\x1b[?2026;2$y", 11) == 11);
+        }
+        if (!attrsAnswered && strstr(buf, "\x1b[c"))
+        {
+            attrsAnswered = (write(master, "\x1b[?62;22c", 9) == 9);
+        }
+        if (len > sizeof(buf) / 2)
+        {
+            // keep the end, where a query may have arrived in part
+            memmove(buf, &buf[len - 16], 16);
+            len = 16;
+        }
+    }
+}
+
+/*
+ * A terminal that answers the mode and device attributes queries is not waited on until
+ * the timeout, and its support for synchronized updates is noticed
+ */
+static int testSyncUpdateQuery()
+{
+    int master;
+    pid_t pid = forkpty(&master, NULL, NULL, NULL);
+    TEST_CHECK(pid != -1);
+
+    if (pid == 0)
+    {
+        long start = termTestNow();
+        if (termEnableRawMode() != 0) _exit(1);
+        long elapsed = termTestNow() - start;
+        bool sync = termHasSyncUpdate();
+        termDisableRawMode();
+        _exit(!sync ? 2 : elapsed > TERM_TEST_ANSWER_MS ? 3 : 0);
+    }
+
+    termTestAnswer(master, pid);
+    int status;
+    waitpid(pid, &status, 0);
+    close(master);
+
+    TEST_CHECK(WIFEXITED(status));
+    TEST_CHECK(WEXITSTATUS(status) != 1);    // raw mode was enabled
+    TEST_CHECK(WEXITSTATUS(status) != 2);    // synchronized updates were noticed
+    TEST_CHECK(WEXITSTATUS(status) != 3);    // the answers were not waited on until the timeout
+    return 0;
+}
+
+/*
+ * Answers to queries that arrive after the query timed out are dropped, not read as keys
+ */
+static int testLateReply()
+{
+    const char *input = "\x1b[?2026;2$y\x1b[?62;22cx\x1b[A";
+    termSetHeadless(input, strlen(input), -1, 24, 80);
+
+    TEST_CHECK(termReadKey() == IDLE_KEY);
+    TEST_CHECK(termReadKey() == IDLE_KEY);
+    TEST_CHECK(termReadKey() == 'x');
+    TEST_CHECK(termReadKey() == ARROW_UP);
+    return 0;
+}
+
+int testTerminal()
+{
+    if (testSyncUpdateQuery() != 0) return -1;
+    return testLateReply();
+}
@@ -0,0 +1,186 @@
+#include "nedtest.h"
+#include "undo.h"
+
+#include <string.h>
+
+#define UNDO_TEST_LIMIT (64 * 1024)
+
+static void undoTestRecord(undo *u, undoType_e type, int row, int col, const char *text)
+{
+    undoRecord(u, type, row, col, text, strlen(text));
+}
+
+/*
+ * Checks that the next operation to undo is the given one, and if the one after it is part
+ * of the same group
+ */
+static int undoTestUndo(undo *u, undoType_e type, int row, int col, const char *text, bool more)
+{
+    undoOp_s op;
+    bool opMore;
+    TEST_CHECK(undoUndo(u, &op, &opMore));
+    TEST_CHECK(op.type == type);
+    TEST_CHECK(op.row == row && op.col == col);
+    TEST_CHECK(op.len == (int) strlen(text) && memcmp(op.text, text, op.len) == 0);
+    TEST_CHECK(opMore == more);
+    return 0;
+}
+
+/*
+ * Typed characters become one insert, and repeated delete or backspace one delete. Switching
+ * between them starts a new group.
+ */
+static int testCoalescing()
+{
+    undo *u = undoNew(UNDO_TEST_LIMIT);
+
+    undoTestRecord(u, UNDO_INSERT, 0, 0, "h");
+    undoTestRecord(u, UNDO_INSERT, 0, 1, "e");
+    undoTestRecord(u, UNDO_INSERT, 0, 2, "llo");
+    undoTestRecord(u, UNDO_INSERT, 0, 5, "\n");
+    undoTestRecord(u, UNDO_INSERT, 1, 0, "x");
+
+    // backspace over "llo\nx", stored back to front and given back in order
+    undoTestRecord(u, UNDO_DELETE, 1, 0, "x");
+    undoTestRecord(u, UNDO_DELETE, 0, 5, "\n");
+    undoTestRecord(u, UNDO_DELETE, 0, 4, "o");
+    undoTestRecord(u, UNDO_DELETE, 0, 2, "ll");
+
+    TEST_CHECK(undoTestUndo(u, UNDO_DELETE, 0, 2, "llo\nx", false) == 0);
+    TEST_CHECK(undoTestUndo(u, UNDO_INSERT, 0, 0, "hello\nx", false) == 0);
+
+    undoOp_s op;
+    bool more;
+    TEST_CHECK(!undoUndo(u, &op, &more));
+
+    // and the same when they are redone
+    TEST_CHECK(undoRedo(u, &op, &more));
+    TEST_CHECK(op.type == UNDO_INSERT && op.len == 7 && memcmp(op.text, "hello\nx", 7) == 0);
+    TEST_CHECK(undoRedo(u, &op, &more));
+    TEST_CHECK(op.type == UNDO_DELETE && op.len == 5 && memcmp(op.text, "llo\nx", 5) == 0);
+    TEST_CHECK(!undoRedo(u, &op, &more));
+
+    undoFree(&u);
+    u = undoNew(UNDO_TEST_LIMIT);
+
+    // delete keeps deleting at the same position
+    undoTestRecord(u, UNDO_DELETE, 3, 1, "a");
+    undoTestRecord(u, UNDO_DELETE, 3, 1, "b");
+    undoTestRecord(u, UNDO_DELETE, 3, 1, "c");
+    TEST_CHECK(undoTestUndo(u, UNDO_DELETE, 3, 1, "abc", false) == 0);
+
+    undoFree(&u);
+    u = undoNew(UNDO_TEST_LIMIT);
+
+    // backspace over multibyte characters, and over a deleted word
+    undoTestRecord(u, UNDO_DELETE, 0, 8, "\xc3\xbc");
+    undoTestRecord(u, UNDO_DELETE, 0, 6, "\xc3\xa9");
+    undoTestRecord(u, UNDO_DELETE, 0, 2, "word");
+    TEST_CHECK(undoTestUndo(u, UNDO_DELETE, 0, 2, "word\xc3\xa9\xc3\xbc", false) == 0);
+
+    undoFree(&u);
+    return 0;
+}
+
+/*
+ * A group ends at undoBreak, and when inserting switches to deleting or back. Adding a row
+ * belongs to the typing around it.
+ */
+static int testGroups()
+{
+    undo *u = undoNew(UNDO_TEST_LIMIT);
+
+    undoTestRecord(u, UNDO_INSERT, 0, 0, "ab");
+    undoBreak(u);
+    undoTestRecord(u, UNDO_INSERT, 0, 2, "c");
+    undoTestRecord(u, UNDO_ADD_ROW, 1, 0, "");
+    undoTestRecord(u, UNDO_INSERT, 1, 0, "d");
+    undoTestRecord(u, UNDO_DELETE, 1, 0, "d");
+    undoTestRecord(u, UNDO_INSERT, 1, 0, "e");
+
+    TEST_CHECK(undoTestUndo(u, UNDO_INSERT, 1, 0, "e", false) == 0);
+    TEST_CHECK(undoTestUndo(u, UNDO_DELETE, 1, 0, "d", false) == 0);
+    TEST_CHECK(undoTestUndo(u, UNDO_INSERT, 1, 0, "d", true) == 0);
+    TEST_CHECK(undoTestUndo(u, UNDO_ADD_ROW, 1, 0, "", true) == 0);
+    TEST_CHECK(undoTestUndo(u, UNDO_INSERT, 0, 2, "c", false) == 0);
+    TEST_CHECK(undoTestUndo(u, UNDO_INSERT, 0, 0, "ab", false) == 0);
+
+    undoFree(&u);
+    return 0;
+}
+
+/*
+ * Recording after an undo forgets what could be redone, and doesn't extend the undone entry
+ */
+static int testRedoTruncation()
+{
+    undo *u = undoNew(UNDO_TEST_LIMIT);
+
+    undoTestRecord(u, UNDO_INSERT, 0, 0, "ab");
+    undoBreak(u);
+    undoTestRecord(u, UNDO_INSERT, 0, 2, "cd");
+    TEST_CHECK(undoTestUndo(u, UNDO_INSERT, 0, 2, "cd", false) == 0);
+
+    undoTestRecord(u, UNDO_INSERT, 0, 2, "x");
+
+    undoOp_s op;
+    bool more;
+    TEST_CHECK(!undoRedo(u, &op, &more));
+    TEST_CHECK(undoTestUndo(u, UNDO_INSERT, 0, 2, "x", false) == 0);
+    TEST_CHECK(undoTestUndo(u, UNDO_INSERT, 0, 0, "ab", false) == 0);
+    TEST_CHECK(!undoUndo(u, &op, &more));
+
+    undoFree(&u);
+    return 0;
+}
+
+/*
+ * Past the limit the oldest groups are dropped, but never a part of one
+ */
+static int testTrim()
+{
+    undo *u = undoNew(4096);
+
+    int numGroups = 200;
+    for (int g = 0; g < numGroups; g++)
+    {
+        undoBreak(u);
+        undoTestRecord(u, UNDO_INSERT, g, 0, "some text");
+        undoTestRecord(u, UNDO_ADD_ROW, g + 1, 0, "");
+    }
+
+    undoOp_s op;
+    bool more;
+    int numUndone = 0;
+    int lastGroup = numGroups;
+    while (undoUndo(u, &op, &more))
+    {
+        // each group is the row and then the text, with the row undone first
+        if (numUndone % 2 == 0)
+        {
+            TEST_CHECK(op.type == UNDO_ADD_ROW && more);
+            TEST_CHECK(op.row == lastGroup);
+        }
+        else
+        {
+            TEST_CHECK(op.type == UNDO_INSERT && !more);
+            TEST_CHECK(op.row == --lastGroup);
+            TEST_CHECK(op.len == 9 && memcmp(op.text, "some text", 9) == 0);
+        }
+        numUndone++;
+    }
+
+    TEST_CHECK(numUndone % 2 == 0);
+    TEST_CHECK(numUndone > 0 && numUndone < numGroups * 2);
+
+    undoFree(&u);
+    return 0;
+}
+
+int testUndo()
+{
+    if (testCoalescing() != 0) return -1;
+    if (testGroups() != 0) return -1;
+    if (testRedoTruncation() != 0) return -1;
+    return testTrim();
+}
@@ -0,0 +1,211 @@
+/*
+ * Generates the perfect hash table for the syntax keywords.
+ *
+ * Usage: kwgen <keywords.txt> <output.h>
+ *
+ * Every line of the input holds a keyword and the termColor_e to draw it with. Empty lines and
+ * lines starting with '#' are ignored. The keywords are first hashed into buckets, then every
+ * bucket gets a seed that puts all of its keywords into free slots of the final table (hash and
+ * displace). A lookup is therefore two hashes and a single compare, no matter how many keywords
+ * there are.
+ */
+#define _DEFAULT_SOURCE
+
+#include "synhash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define KWGEN_MAX_SEED 10000000u
+
+typedef struct
+{
+    char *key;
+    int len;
+    char *color;
+    int bucket;
+    int slot;
+} kwEntry_s;
+
+static kwEntry_s *entries = NULL;
+static int numEntries = 0;
+
+
+static int kwgenRead(const char *filename)
+{
+    FILE *fp = fopen(filename, "r");
+    if (!fp)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    int capacity = 0;
+    char line[256];
+    int lineNo = 0;
+    while (fgets(line, sizeof(line), fp))
+    {
+        lineNo++;
+        char *key = strtok(line, " \t\r\n");
+        if (!key || key[0] == '#') continue;
+
+        char *color = strtok(NULL, " \t\r\n");
+        if (!color)
+        {
+            fprintf(stderr, "%s:%d: missing color for '%s'\n", filename, lineNo, key);
+            fclose(fp);
+            return -1;
+        }
+
+        for (int i = 0; i < numEntries; i++)
+        {
+            if (strcmp(entries[i].key, key) == 0)
+            {
+                fprintf(stderr, "%s:%d: duplicate keyword '%s'\n", filename, lineNo, key);
+                fclose(fp);
+                return -1;
+            }
+        }
+
+        if (numEntries == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            entries = realloc(entries, sizeof(*entries) * capacity);
+        }
+
+        kwEntry_s *e = &entries[numEntries++];
+        e->key = strdup(key);
+        e->len = strlen(key);
+        e->color = strdup(color);
+        e->slot = -1;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+static int nextPow2(int n)
+{
+    int p = 1;
+    while (p < n) p *= 2;
+    return p;
+}
+
+/*
+ * Finds a seed for every bucket, so that all keywords end up in distinct slots
+ */
+static int kwgenPlace(int numBuckets, int numSlots, uint32_t *seeds, int *slots)
+{
+    for (int i = 0; i < numSlots; i++) slots[i] = -1;
+
+    for (int i = 0; i < numEntries; i++)
+    {
+        entries[i].bucket = synHash(entries[i].key, entries[i].len, 0) & (numBuckets - 1);
+    }
+
+    int *bucketSize = calloc(numBuckets, sizeof(*bucketSize));
+    for (int i = 0; i < numEntries; i++) bucketSize[entries[i].bucket]++;
+
+    // place the largest buckets first, while there is still plenty of room
+    for (int size = numEntries; size > 0; size--)
+    {
+        for (int b = 0; b < numBuckets; b++)
+        {
+            if (bucketSize[b] != size) continue;
+
+            uint32_t seed;
+            for (seed = 1; seed < KWGEN_MAX_SEED; seed++)
+            {
+                bool ok = true;
+                for (int i = 0; i < numEntries && ok; i++)
+                {
+                    if (entries[i].bucket != b) continue;
+                    int slot = synHash(entries[i].key, entries[i].len, seed) & (numSlots - 1);
+                    if (slots[slot] != -1) ok = false;
+                    else slots[slot] = i;
+                }
+
+                if (ok) break;
+
+                // undo the partial placement and try the next seed
+                for (int s = 0; s < numSlots; s++)
+                {
+                    if (slots[s] != -1 && entries[slots[s]].bucket == b) slots[s] = -1;
+                }
+            }
+
+            if (seed == KWGEN_MAX_SEED)
+            {
+                free(bucketSize);
+                return -1;
+            }
+
+            seeds[b] = seed;
+        }
+    }
+
+    free(bucketSize);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s <keywords.txt> <output.h>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (kwgenRead(argv[1]) == -1) return EXIT_FAILURE;
+
+    int numBuckets = nextPow2(numEntries / 2 + 1);
+    int numSlots = nextPow2(numEntries * 2);
+    uint32_t *seeds = calloc(numBuckets, sizeof(*seeds));
+    int *slots = malloc(sizeof(*slots) * numSlots);
+
+    if (kwgenPlace(numBuckets, numSlots, seeds, slots) == -1)
+    {
+        fprintf(stderr, "failed to find a perfect hash for %d keywords\n", numEntries);
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = fopen(argv[2], "w");
+    if (!out)
+    {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "// Generated by tools/kwgen.c from %s, do not edit\n\n", argv[1]);
+    fprintf(out, "#pragma once\n\n");
+    fprintf(out, "#include \"synhash.h\"\n\n");
+    fprintf(out, "#define SYN_KEYWORD_COUNT %d\n", numEntries);
+    fprintf(out, "#define SYN_KEYWORD_BUCKETS %d\n", numBuckets);
+    fprintf(out, "#define SYN_KEYWORD_SLOTS %d\n\n", numSlots);
+
+    fprintf(out, "static const uint32_t synKeywordSeeds[SYN_KEYWORD_BUCKETS] =\n{\n");
+    for (int b = 0; b < numBuckets; b++)
+    {
+        fprintf(out, "%s%u,%s", (b % 8 == 0) ? "    " : " ", seeds[b], (b % 8 == 7 || b == numBuckets - 1) ? "\n" : "");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static const struct keyword synKeywords[SYN_KEYWORD_SLOTS] =\n{\n");
+    for (int s = 0; s < numSlots; s++)
+    {
+        if (slots[s] == -1) continue;
+        kwEntry_s *e = &entries[slots[s]];
+        fprintf(out, "    [%d] = { \"%s\", %d, %s },\n", s, e->key, e->len, e->color);
+    }
+    fprintf(out, "};\n");
+
+    if (fclose(out) != 0)
+    {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}